@@ -0,0 +1,181 @@
+// Decodes a set of profile responses on worker pools of 1 to hardware_concurrency threads and reports throughput.
+// Bodies come from a session recorded with -record, or are generated when no recording is given.
+//
+// Usage: DecodeBench [recording directory] [bodies]
+#include "leetify_provider.h"
+#include "session_capture.h"
+#include "worker_pool.h"
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Best of this many runs per pool size, the first run also warms up the allocator
+constexpr int RUNS = 5;
+
+constexpr size_t DEFAULT_BODIES = 2000;
+
+// Shaped like a real profile response, with a full list of recent teammates
+static std::string GenerateBody(uint64 steamID)
+{
+	nlohmann::json stats;
+	for (auto key : {"accuracy_enemy_spotted", "accuracy_head", "counter_strafing_good_shots_ratio",
+	                 "ct_opening_aggression_success_rate", "ct_opening_duel_success_percentage",
+	                 "flashbang_hit_foe_avg_duration", "flashbang_hit_foe_per_flashbang",
+	                 "flashbang_hit_friend_per_flashbang", "flashbang_leading_to_kill", "flashbang_thrown",
+	                 "he_foes_damage_avg", "he_friends_damage_avg", "preaim", "reaction_time_ms", "spray_accuracy",
+	                 "t_opening_aggression_success_rate", "t_opening_duel_success_percentage",
+	                 "traded_deaths_success_percentage", "trade_kill_opportunities_per_round",
+	                 "trade_kills_success_percentage", "utility_on_death_avg"})
+	{
+		stats[key] = static_cast<double>(steamID % 997) / 7.0;
+	}
+
+	auto teammates = nlohmann::json::array();
+	for (uint64 i = 1; i <= 30; i++)
+	{
+		teammates.push_back({{"steam64_id", std::to_string(steamID + i)}, {"recent_matches_count", i % 7}});
+	}
+
+	nlohmann::json profile = {
+	    {"name", "player " + std::to_string(steamID)},
+	    {"winrate", 0.52},
+	    {"total_matches", steamID % 3000},
+	    {"first_match_date", "2021-03-14T15:09:26.000Z"},
+	    {"rating",
+	     {{"aim", 71.3}, {"positioning", 55.0}, {"utility", 48.2}, {"clutch", 0.12}, {"opening", 0.03},
+	      {"ct_leetify", 0.01}, {"t_leetify", -0.02}}},
+	    {"ranks", {{"leetify", 1.74}, {"premier", 18250}, {"faceit", 7}, {"faceit_elo", 1850}}},
+	    {"stats", stats},
+	    {"bans", nlohmann::json::array()},
+	    {"recent_teammates", teammates},
+	};
+
+	return profile.dump();
+}
+
+static std::vector<std::string> LoadBodies(const char *directory)
+{
+	std::vector<std::string> bodies;
+
+	SessionCapture capture;
+	if (!capture.Load(directory))
+	{
+		return bodies;
+	}
+
+	for (const auto &transfer : capture.Transfers())
+	{
+		if (transfer.responseCode == 200 && !transfer.body.empty())
+		{
+			bodies.push_back(transfer.body);
+		}
+	}
+
+	return bodies;
+}
+
+// Decodes every body once as a task of its own, like responses landing during a fetch
+static Clock::duration DecodeAll(WorkerPool &pool, const std::vector<std::string> &bodies, std::atomic<size_t> &failed)
+{
+	TaskGroup group;
+	auto started = Clock::now();
+
+	for (const auto &body : bodies)
+	{
+		group.Add();
+		pool.Submit([&body, &group, &failed]() {
+			try
+			{
+				LeetifyUser user;
+				ParseLeetifyUser(body, &user);
+			}
+			catch (const std::exception &)
+			{
+				failed++;
+			}
+
+			group.Done();
+		});
+	}
+
+	group.Wait();
+	return Clock::now() - started;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> recorded;
+	if (argc > 1)
+	{
+		recorded = LoadBodies(argv[1]);
+		if (recorded.empty())
+		{
+			printf("No successful transfers recorded in %s\n", argv[1]);
+			return 1;
+		}
+	}
+
+	auto count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : DEFAULT_BODIES;
+	if (count == 0)
+	{
+		printf("Invalid body count %s\n", argv[2]);
+		return 1;
+	}
+
+	// Recorded bodies are repeated until there are enough of them to keep every worker busy
+	std::vector<std::string> bodies;
+	size_t totalBytes = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		bodies.push_back(recorded.empty() ? GenerateBody(76561198000000000ull + i) : recorded[i % recorded.size()]);
+		totalBytes += bodies.back().size();
+	}
+
+	auto maxWorkers = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+	printf("%zu bodies, %.1f KB average, %s\n", bodies.size(), totalBytes / 1024.0 / bodies.size(),
+	       recorded.empty() ? "generated" : "recorded");
+	printf("%8s %12s %12s %10s %8s\n", "workers", "best ms", "bodies/s", "MB/s", "speedup");
+
+	double baseline = 0.0;
+
+	for (unsigned workers = 1; workers <= maxWorkers; workers++)
+	{
+		WorkerPool pool(workers);
+		std::atomic<size_t> failed = 0;
+		auto best = Clock::duration::max();
+
+		for (int run = 0; run < RUNS; run++)
+		{
+			best = (std::min)(best, DecodeAll(pool, bodies, failed));
+		}
+
+		auto seconds = std::chrono::duration<double>(best).count();
+		auto bodiesPerSecond = bodies.size() / seconds;
+
+		if (workers == 1)
+		{
+			baseline = bodiesPerSecond;
+		}
+
+		printf("%8u %12.2f %12.0f %10.1f %7.2fx\n", workers, seconds * 1000.0, bodiesPerSecond,
+		       totalBytes / seconds / (1024.0 * 1024.0), bodiesPerSecond / baseline);
+
+		if (failed > 0)
+		{
+			printf("%zu bodies failed to decode\n", failed.load() / RUNS);
+		}
+	}
+
+	return 0;
+}
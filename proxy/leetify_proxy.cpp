@@ -0,0 +1,430 @@
+#include "leetify_proxy.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#define closesocket_ closesocket
+#define SHUT_RDWR SD_BOTH
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#define closesocket_ close
+#endif
+
+#include <curl/curl.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// Most ids accepted in a single request, a lobby never has more than 10 players
+constexpr size_t MAX_IDS_PER_REQUEST = 100;
+
+// Upstream transfers kept in flight per request
+constexpr long MAX_UPSTREAM_CONNECTIONS = 16;
+
+// Profiles change at most once per match, so clients asking for the same lobby can share results for a while
+constexpr auto CACHE_TTL = std::chrono::seconds(60);
+
+// Pause after accept fails with something retrying won't fix right away, such as running out of descriptors
+constexpr auto ACCEPT_RETRY_DELAY = std::chrono::milliseconds(50);
+
+static int LastSocketError()
+{
+#ifdef _WIN32
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+// A signal or a client that gave up before being accepted, the next accept can go ahead
+static bool TransientAcceptError(int error)
+{
+#ifdef _WIN32
+	return error == WSAEINTR || error == WSAECONNRESET;
+#else
+	return error == EINTR || error == ECONNABORTED;
+#endif
+}
+
+static size_t WriteCallback(void *contents, size_t size, size_t nmemb, std::string *s)
+{
+	s->append((char *)contents, size * nmemb);
+	return size * nmemb;
+}
+
+LeetifyProxy::LeetifyProxy(std::string upstream) : upstream(std::move(upstream)), server(INVALID_SOCKET)
+{
+}
+
+LeetifyProxy::~LeetifyProxy()
+{
+	Stop();
+}
+
+bool LeetifyProxy::Listen(int requestedPort)
+{
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	if (server == INVALID_SOCKET)
+	{
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((unsigned short)requestedPort);
+
+	socklen_t length = sizeof(address);
+	if (bind(server, (sockaddr *)&address, sizeof(address)) != 0 || listen(server, SOMAXCONN) != 0 ||
+	    getsockname(server, (sockaddr *)&address, &length) != 0)
+	{
+		closesocket_(server);
+		server = INVALID_SOCKET;
+		return false;
+	}
+
+	port = ntohs(address.sin_port);
+	return true;
+}
+
+void LeetifyProxy::Serve()
+{
+	while (!stopping)
+	{
+		auto client = accept(server, nullptr, nullptr);
+		if (client == INVALID_SOCKET)
+		{
+			auto error = LastSocketError();
+			if (!stopping && !TransientAcceptError(error))
+			{
+				printf("accept failed: error %d\n", error);
+				std::this_thread::sleep_for(ACCEPT_RETRY_DELAY);
+			}
+			continue;
+		}
+
+		{
+			std::lock_guard lock(clientsMutex);
+			clients++;
+		}
+
+		std::thread([this, client]() {
+			HandleClient(client);
+
+			std::lock_guard lock(clientsMutex);
+			clients--;
+			clientsDone.notify_all();
+		}).detach();
+	}
+}
+
+void LeetifyProxy::Stop()
+{
+	if (stopping.exchange(true) || server == INVALID_SOCKET)
+	{
+		return;
+	}
+
+	// Shutting the socket down is what wakes a blocked accept on Linux, closing it is enough on Windows
+	shutdown(server, SHUT_RDWR);
+	closesocket_(server);
+
+	std::unique_lock lock(clientsMutex);
+	clientsDone.wait(lock, [this] { return clients == 0; });
+}
+
+bool LeetifyProxy::LookupCache(const std::string &id, CachedProfile *result)
+{
+	std::lock_guard lock(cacheMutex);
+
+	auto it = cache.find(id);
+	if (it == cache.end() || Clock::now() - it->second.fetched > CACHE_TTL)
+	{
+		return false;
+	}
+
+	*result = it->second;
+	return true;
+}
+
+void LeetifyProxy::StoreCache(const std::string &id, long status, const nlohmann::json &profile)
+{
+	std::lock_guard lock(cacheMutex);
+
+	// Expired entries are only swept when storing, the map stays as small as the set of recently seen players
+	std::erase_if(cache, [](const auto &entry) { return Clock::now() - entry.second.fetched > CACHE_TTL; });
+	cache[id] = {status, profile, Clock::now()};
+}
+
+// Fans the ids out to the upstream API and combines whatever comes back
+nlohmann::json LeetifyProxy::FetchProfiles(const std::vector<std::string> &ids)
+{
+	auto result = nlohmann::json{{"profiles", nlohmann::json::object()}, {"errors", nlohmann::json::object()}};
+
+	struct Transfer
+	{
+		std::string id;
+		CURL *handle;
+		std::string response;
+	};
+
+	std::vector<Transfer> transfers;
+	transfers.reserve(ids.size());
+
+	for (const auto &id : ids)
+	{
+		CachedProfile cached;
+		if (LookupCache(id, &cached))
+		{
+			if (cached.status == 200)
+			{
+				result["profiles"][id] = cached.profile;
+			}
+			else
+			{
+				result["errors"][id] = cached.status;
+			}
+			continue;
+		}
+
+		transfers.push_back({id, curl_easy_init(), ""});
+	}
+
+	auto multiHandle = curl_multi_init();
+	curl_multi_setopt(multiHandle, CURLMOPT_MAX_TOTAL_CONNECTIONS, MAX_UPSTREAM_CONNECTIONS);
+
+	for (auto &transfer : transfers)
+	{
+		if (!transfer.handle)
+		{
+			continue;
+		}
+
+		auto url = upstream + transfer.id;
+		curl_easy_setopt(transfer.handle, CURLOPT_URL, url.c_str());
+		curl_easy_setopt(transfer.handle, CURLOPT_USERAGENT,
+		                 "CS2 Player Fetcher (+https://github.com/Poggicek/CS2-Player-Fetcher)");
+		curl_easy_setopt(transfer.handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+		curl_easy_setopt(transfer.handle, CURLOPT_WRITEDATA, &transfer.response);
+		curl_easy_setopt(transfer.handle, CURLOPT_TIMEOUT, 60L);
+		curl_easy_setopt(transfer.handle, CURLOPT_ACCEPT_ENCODING, "");
+		curl_multi_add_handle(multiHandle, transfer.handle);
+	}
+
+	int stillRunning = 0;
+	do
+	{
+		curl_multi_perform(multiHandle, &stillRunning);
+
+		if (stillRunning)
+		{
+			curl_multi_poll(multiHandle, nullptr, 0, 1000, nullptr);
+		}
+	} while (stillRunning);
+
+	for (auto &transfer : transfers)
+	{
+		long status = 502;
+
+		if (transfer.handle)
+		{
+			curl_easy_getinfo(transfer.handle, CURLINFO_RESPONSE_CODE, &status);
+			curl_multi_remove_handle(multiHandle, transfer.handle);
+			curl_easy_cleanup(transfer.handle);
+		}
+
+		// A failed transfer reports 0, which would read as success to nobody
+		if (status == 0)
+		{
+			status = 502;
+		}
+
+		if (status == 200)
+		{
+			try
+			{
+				auto profile = nlohmann::json::parse(transfer.response);
+				result["profiles"][transfer.id] = profile;
+				StoreCache(transfer.id, status, profile);
+				continue;
+			}
+			catch (const std::exception &e)
+			{
+				printf("fail: %s - error %s\n", transfer.id.c_str(), e.what());
+				status = 502;
+			}
+		}
+
+		if (status == 404)
+		{
+			StoreCache(transfer.id, status, nullptr);
+		}
+
+		result["errors"][transfer.id] = status;
+	}
+
+	curl_multi_cleanup(multiHandle);
+	return result;
+}
+
+static bool Gzip(const std::string &input, std::string *output)
+{
+	z_stream stream = {};
+
+	// 16 on top of the window bits selects the gzip wrapper over raw zlib
+	if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return false;
+	}
+
+	output->resize(deflateBound(&stream, input.size()));
+	stream.next_in = (Bytef *)input.data();
+	stream.avail_in = (uInt)input.size();
+	stream.next_out = (Bytef *)output->data();
+	stream.avail_out = (uInt)output->size();
+
+	auto result = deflate(&stream, Z_FINISH);
+	output->resize(stream.total_out);
+	deflateEnd(&stream);
+
+	return result == Z_STREAM_END;
+}
+
+static void SendResponse(Socket client, int status, const char *reason, const std::string &body, bool gzip)
+{
+	std::string encoded;
+	auto compressed = gzip && Gzip(body, &encoded);
+	const auto &payload = compressed ? encoded : body;
+
+	auto response = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n" +
+	                "Content-Type: application/json\r\n" + "Content-Length: " + std::to_string(payload.size()) +
+	                "\r\n" + (compressed ? "Content-Encoding: gzip\r\n" : "") + "Connection: close\r\n\r\n" + payload;
+
+	size_t sent = 0;
+	while (sent < response.size())
+	{
+		auto n = send(client, response.data() + sent, (int)(response.size() - sent), 0);
+		if (n <= 0)
+		{
+			break;
+		}
+		sent += n;
+	}
+}
+
+static std::vector<std::string> ParseIds(const std::string &target)
+{
+	std::vector<std::string> ids;
+
+	auto query = target.find("ids=");
+	if (query == std::string::npos || (query > 0 && target[query - 1] != '?' && target[query - 1] != '&'))
+	{
+		return ids;
+	}
+
+	auto list = target.substr(query + 4, target.find('&', query) - (query + 4));
+
+	// Commas may arrive percent-encoded
+	for (size_t pos; (pos = list.find("%2C")) != std::string::npos || (pos = list.find("%2c")) != std::string::npos;)
+	{
+		list.replace(pos, 3, ",");
+	}
+
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		auto end = (std::min)(list.find(',', start), list.size());
+		auto id = list.substr(start, end - start);
+
+		if (!id.empty() && id.size() <= 20 && std::all_of(id.begin(), id.end(), [](unsigned char c) { return std::isdigit(c); }) &&
+		    std::find(ids.begin(), ids.end(), id) == ids.end())
+		{
+			ids.push_back(id);
+		}
+
+		start = end + 1;
+	}
+
+	return ids;
+}
+
+void LeetifyProxy::HandleClient(Socket client)
+{
+	std::string request;
+	char buffer[4096];
+
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < 65536)
+	{
+		auto n = recv(client, buffer, sizeof(buffer), 0);
+		if (n <= 0)
+		{
+			closesocket_(client);
+			return;
+		}
+		request.append(buffer, n);
+	}
+
+	auto lineEnd = request.find("\r\n");
+	auto requestLine = request.substr(0, lineEnd);
+	auto methodEnd = requestLine.find(' ');
+	auto targetEnd = requestLine.find(' ', methodEnd + 1);
+
+	if (methodEnd == std::string::npos || targetEnd == std::string::npos)
+	{
+		SendResponse(client, 400, "Bad Request", R"({"error":"malformed request"})", false);
+		closesocket_(client);
+		return;
+	}
+
+	auto method = requestLine.substr(0, methodEnd);
+	auto target = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+
+	auto headers = request.substr(lineEnd);
+	std::transform(headers.begin(), headers.end(), headers.begin(),
+	               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	auto encodingHeader = headers.find("\r\naccept-encoding:");
+	auto gzip = encodingHeader != std::string::npos &&
+	            headers.substr(encodingHeader, headers.find("\r\n", encodingHeader + 2) - encodingHeader)
+	                    .find("gzip") != std::string::npos;
+
+	if (method != "GET")
+	{
+		SendResponse(client, 405, "Method Not Allowed", R"({"error":"only GET is supported"})", false);
+	}
+	else if (target.substr(0, target.find('?')) != "/v2/profiles")
+	{
+		SendResponse(client, 404, "Not Found", R"({"error":"unknown route"})", false);
+	}
+	else
+	{
+		auto ids = ParseIds(target);
+
+		if (ids.empty() || ids.size() > MAX_IDS_PER_REQUEST)
+		{
+			SendResponse(client, 400, "Bad Request",
+			             R"({"error":"expected 1-)" + std::to_string(MAX_IDS_PER_REQUEST) + R"( steam64 ids"})", false);
+		}
+		else
+		{
+			auto started = Clock::now();
+			auto body = FetchProfiles(ids).dump();
+			SendResponse(client, 200, "OK", body, gzip);
+
+			printf("%zu profiles in %lld ms\n", ids.size(),
+			       (long long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count());
+		}
+	}
+
+	closesocket_(client);
+}
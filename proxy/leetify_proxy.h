@@ -0,0 +1,78 @@
+#pragma once
+
+#ifdef _WIN32
+#include <winsock2.h>
+using Socket = SOCKET;
+#else
+using Socket = int;
+#endif
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Local aggregation proxy for the Leetify public API, which only serves profiles one at a time.
+// Answers GET /v2/profiles?ids=<steam64>,<steam64>,... by fetching every profile upstream in parallel and returning
+// one combined response: {"profiles": {"<steam64>": {...}}, "errors": {"<steam64>": <status>}}
+class LeetifyProxy
+{
+  public:
+	// Profiles are fetched from upstream + <steam64>
+	explicit LeetifyProxy(std::string upstream);
+	~LeetifyProxy();
+
+	LeetifyProxy(const LeetifyProxy &) = delete;
+	LeetifyProxy &operator=(const LeetifyProxy &) = delete;
+
+	// Only on the loopback interface, the proxy has no notion of who is asking. Port 0 picks a free one.
+	bool Listen(int port);
+
+	int Port() const
+	{
+		return port;
+	}
+
+	const std::string &Upstream() const
+	{
+		return upstream;
+	}
+
+	// Accepts clients until Stop is called, each one is handled on a thread of its own
+	void Serve();
+
+	// Makes Serve return and waits for the clients still being handled, callable from any thread
+	void Stop();
+
+  private:
+	using Clock = std::chrono::steady_clock;
+
+	struct CachedProfile
+	{
+		long status;
+		nlohmann::json profile;
+		Clock::time_point fetched;
+	};
+
+	bool LookupCache(const std::string &id, CachedProfile *result);
+	void StoreCache(const std::string &id, long status, const nlohmann::json &profile);
+	nlohmann::json FetchProfiles(const std::vector<std::string> &ids);
+	void HandleClient(Socket client);
+
+	std::string upstream;
+	Socket server;
+	int port = 0;
+	std::atomic<bool> stopping = false;
+
+	std::mutex cacheMutex;
+	std::unordered_map<std::string, CachedProfile> cache;
+
+	std::mutex clientsMutex;
+	std::condition_variable clientsDone;
+	size_t clients = 0;
+};
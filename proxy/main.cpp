@@ -0,0 +1,51 @@
+// Runs LeetifyProxy on its own, see leetify_proxy.h for what it answers
+#include "leetify_proxy.h"
+
+#include <curl/curl.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char *argv[])
+{
+	auto port = 8787;
+
+	if (argc > 1)
+	{
+		char *end;
+		errno = 0;
+		auto parsed = strtol(argv[1], &end, 10);
+
+		if (end == argv[1] || *end != '\0' || errno == ERANGE || parsed < 0 || parsed > 65535)
+		{
+			printf("Invalid port %s\n", argv[1]);
+			return 1;
+		}
+
+		port = static_cast<int>(parsed);
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		printf("Failed to initialize Winsock\n");
+		return 1;
+	}
+#endif
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	LeetifyProxy proxy(argc > 2 ? argv[2] : "https://api-public.cs-prod.leetify.com/v2/profiles/");
+
+	if (!proxy.Listen(port))
+	{
+		printf("Failed to listen on port %d\n", port);
+		return 1;
+	}
+
+	printf("Listening on http://127.0.0.1:%d/v2/profiles, upstream %s\n", proxy.Port(), proxy.Upstream().c_str());
+	proxy.Serve();
+}
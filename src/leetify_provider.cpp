@@ -2,6 +2,20 @@
 #include <nlohmann/json.hpp>
 
 #include "leetify_provider.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
 
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb, std::string *userp)
 {
@@ -11,217 +25,1304 @@ static size_t WriteCallback(void *contents, size_t size, size_t nmemb, std::stri
 
 struct CurlHandle
 {
-	LeetifyUser *user;
-	CURL *handle;
+	// More than one when the transfer goes through the batch endpoint
+	std::vector<size_t> userIndices;
+
+	// Null for batch placeholders and replayed transfers
+	CURL *handle = nullptr;
+
+	// Queued for a batch, the transfer itself is created once the batch is admitted
+	bool placeholder = false;
 	std::string response;
+	std::string headers;
+	FetchPriority priority;
+	size_t order;
+	Clock::time_point queued;
+	Clock::time_point started;
+
+	// Duplicate racing this transfer, or the original transfer if this is the duplicate
+	CurlHandle *hedge = nullptr;
+	bool finished = false;
+
+	// Cleaned up and about to be erased from handles
+	bool reaped = false;
+
+	// Replayed transfers land at this time with the recorded outcome of each user instead of going through cURL
+	Clock::time_point due;
+	std::vector<const TransferRecord *> replayed;
+};
+
+// Orders the pending queue so that the highest priority, then the earliest queued, handle is on top
+struct PendingOrder
+{
+	bool operator()(const CurlHandle *a, const CurlHandle *b) const
+	{
+		if (a->priority != b->priority)
+		{
+			return a->priority > b->priority;
+		}
+
+		return a->order > b->order;
+	}
+};
+
+// Durations of recent successful transfers, kept across runs so hedging can use the observed p95
+class LatencyTracker
+{
+  public:
+	void Add(Clock::duration latency)
+	{
+		std::lock_guard lock(mutex);
+
+		if (samples.size() < maxSamples)
+		{
+			samples.push_back(latency);
+		}
+		else
+		{
+			samples[next] = latency;
+		}
+
+		next = (next + 1) % maxSamples;
+	}
+
+	std::optional<Clock::duration> Percentile(double percentile)
+	{
+		std::lock_guard lock(mutex);
+
+		if (samples.size() < minSamples)
+		{
+			return std::nullopt;
+		}
+
+		auto sorted = samples;
+		auto nth = sorted.begin() + static_cast<size_t>(percentile * (sorted.size() - 1));
+		std::nth_element(sorted.begin(), nth, sorted.end());
+		return *nth;
+	}
+
+  private:
+	static constexpr size_t minSamples = 5;
+	static constexpr size_t maxSamples = 256;
+
+	std::mutex mutex;
+	std::vector<Clock::duration> samples;
+	size_t next = 0;
 };
 
+static LatencyTracker s_latencies;
+
 template <typename T> T getValue(const nlohmann::json &j, const std::string &key, const T &defaultValue = T())
 {
 	return j.contains(key) && !j[key].is_null() ? j.value(key, defaultValue) : defaultValue;
 }
 
-std::vector<LeetifyUser> GetLeetifyUsers(const std::vector<Player> &players)
+static void ParseLeetifyUser(const nlohmann::json &json, LeetifyUser *user)
+{
+	user->name = getValue(json, "name", std::string(""));
+	user->winRate = getValue(json, "winrate", 0.0f) * 100.0f;
+	user->totalMatches = getValue(json, "total_matches", 0);
+
+	if (json.contains("first_match_date") && json["first_match_date"].is_string())
+	{
+		std::istringstream iss(json["first_match_date"].get<std::string>());
+		std::chrono::from_stream(iss, "%Y-%m-%dT%H:%M:%S%Z", user->firstMatchDate);
+	}
+
+	if (json.contains("rating") && json["rating"].is_object())
+	{
+		auto &rating = json["rating"];
+		user->rating.aim = getValue(rating, "aim", 0.0f);
+		user->rating.positioning = getValue(rating, "positioning", 0.0f);
+		user->rating.utility = getValue(rating, "utility", 0.0f);
+		user->rating.clutch = getValue(rating, "clutch", 0.0f);
+		user->rating.opening = getValue(rating, "opening", 0.0f);
+		user->rating.ct_leetify = getValue(rating, "ct_leetify", 0.0f);
+		user->rating.t_leetify = getValue(rating, "t_leetify", 0.0f);
+	}
+
+	if (json.contains("ranks") && json["ranks"].is_object())
+	{
+		auto &ranks = json["ranks"];
+		user->ranks.leetify = getValue(ranks, "leetify", 0.0f);
+		user->ranks.premier = getValue(ranks, "premier", 0);
+		user->ranks.faceit = getValue(ranks, "faceit_elo", 0);
+	}
+
+	if (json.contains("stats") && json["stats"].is_object())
+	{
+		auto &skills = json["stats"];
+		user->skills.accuracy_enemy_spotted = getValue(skills, "accuracy_enemy_spotted", 0.0f);
+		user->skills.accuracy_head = getValue(skills, "accuracy_head", 0.0f);
+		user->skills.counter_strafing_good_shots_ratio =
+		    getValue(skills, "counter_strafing_good_shots_ratio", 0.0f);
+		user->skills.ct_opening_aggression_success_rate =
+		    getValue(skills, "ct_opening_aggression_success_rate", 0.0f);
+		user->skills.ct_opening_duel_success_percentage =
+		    getValue(skills, "ct_opening_duel_success_percentage", 0.0f);
+		user->skills.flashbang_hit_foe_avg_duration =
+		    getValue(skills, "flashbang_hit_foe_avg_duration", 0.0f);
+		user->skills.flashbang_hit_foe_per_flashbang =
+		    getValue(skills, "flashbang_hit_foe_per_flashbang", 0.0f);
+		user->skills.flashbang_hit_friend_per_flashbang =
+		    getValue(skills, "flashbang_hit_friend_per_flashbang", 0.0f);
+		user->skills.flashbang_leading_to_kill = getValue(skills, "flashbang_leading_to_kill", 0.0f);
+		user->skills.flashbang_thrown = getValue(skills, "flashbang_thrown", 0.0f);
+		user->skills.he_foes_damage_avg = getValue(skills, "he_foes_damage_avg", 0.0f);
+		user->skills.he_friends_damage_avg = getValue(skills, "he_friends_damage_avg", 0.0f);
+		user->skills.preaim = getValue(skills, "preaim", 0.0f);
+		user->skills.reaction_time = getValue(skills, "reaction_time_ms", 0.0f);
+		user->skills.spray_accuracy = getValue(skills, "spray_accuracy", 0.0f);
+		user->skills.t_opening_aggression_success_rate =
+		    getValue(skills, "t_opening_aggression_success_rate", 0.0f);
+		user->skills.t_opening_duel_success_percentage =
+		    getValue(skills, "t_opening_duel_success_percentage", 0.0f);
+		user->skills.traded_deaths_success_percentage =
+		    getValue(skills, "traded_deaths_success_percentage", 0.0f);
+		user->skills.trade_kill_opportunities_per_round =
+		    getValue(skills, "trade_kill_opportunities_per_round", 0.0f);
+		user->skills.trade_kills_success_percentage =
+		    getValue(skills, "trade_kills_success_percentage", 0.0f);
+		user->skills.utility_on_death_avg = getValue(skills, "utility_on_death_avg", 0.0f);
+	}
+
+	if (json.contains("bans") && json["bans"].is_array())
+	{
+		for (const auto &ban : json["bans"])
+		{
+			user->bans.push_back(getValue(ban, "platform", std::string("")));
+		}
+	}
+
+	if (json.contains("recent_teammates") && json["recent_teammates"].is_array())
+	{
+		for (const auto &teammate : json["recent_teammates"])
+		{
+			auto steam64_id = std::stoull(getValue(teammate, "steam64_id", std::string("0")));
+			auto matchCount = getValue(teammate, "recent_matches_count", 0);
+
+			user->recentTeammates.emplace_back(CSteamID(steam64_id), matchCount);
+		}
+	}
+
+	user->success = true;
+}
+
+void ParseLeetifyUser(const std::string &body, LeetifyUser *user)
+{
+	ParseLeetifyUser(nlohmann::json::parse(body), user);
+}
+
+// Everything a fetch needs, driven by the fetch thread owned by LeetifyFetch
+struct FetchSession
 {
-	curl_global_init(CURL_GLOBAL_DEFAULT);
+	FetchOptions options;
+	Clock::time_point origin = Clock::now();
+	CURLM *multiHandle = nullptr;
+
+	// Guards users, userIndices, submitted, cancelled and stopping, which the caller and the worker pool share with
+	// the fetch thread. The fetch thread only changes them with the lock held, so it may read them without.
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable resolved;
+
+	// A deque so decoding tasks can keep pointing at a user while more are submitted
+	std::deque<LeetifyUser> users;
+	std::unordered_map<uint64, size_t> userIndices;
+	std::vector<Player> submitted;
+	std::vector<CSteamID> cancelled;
+	bool stopping = false;
+
+	// Only touched by the fetch thread, steamIDs mirrors users so it can be read without the lock
+	std::vector<CSteamID> steamIDs;
+	std::vector<bool> dropped;
+	std::vector<std::unique_ptr<CurlHandle>> handles;
+	std::priority_queue<CurlHandle *, std::vector<CurlHandle *>, PendingOrder> pending;
+	std::vector<CurlHandle *> active;
+	size_t maxActive;
+
+	// Responses being decoded on the worker pool
+	TaskGroup decoding;
+
+	// Recorded transfers of each player in the order they started, and how many of them have been played back
+	std::unordered_map<uint64, std::vector<const TransferRecord *>> recordings;
+	std::unordered_map<uint64, size_t> replayAttempts;
+
+	FetchSession(const FetchOptions &fetchOptions)
+	    : options(fetchOptions), maxActive(static_cast<size_t>((std::max)(1, fetchOptions.maxConcurrentTransfers)))
+	{
+		curl_global_init(CURL_GLOBAL_DEFAULT);
+		multiHandle = curl_multi_init();
+
+		if (options.replay)
+		{
+			LoadRecordings();
+		}
+		else if (!multiHandle)
+		{
+			Log("Failed to initialize CURL multi handle");
+		}
+	}
+
+	~FetchSession()
+	{
+		for (auto &handle : handles)
+		{
+			if (!handle->handle)
+			{
+				continue;
+			}
+
+			if (multiHandle)
+			{
+				curl_multi_remove_handle(multiHandle, handle->handle);
+			}
+			curl_easy_cleanup(handle->handle);
+		}
 
-	std::vector<LeetifyUser> users(players.size());
-	std::vector<std::unique_ptr<CurlHandle>> handles(players.size());
+		if (multiHandle)
+		{
+			curl_multi_cleanup(multiHandle);
+		}
+		curl_global_cleanup();
+	}
 
-	CURLM *multiHandle = curl_multi_init();
-	if (!multiHandle)
+	bool Batching() const
 	{
-		printf("Failed to initialize CURL multi handle\n");
-		return users;
+		return !options.batchEndpoint.empty();
 	}
 
-	for (auto i = 0; i < players.size(); i++)
+	CurlHandle *CreateHandle(const std::vector<size_t> &userIndices, FetchPriority priority)
 	{
 		auto handle = std::make_unique<CurlHandle>();
-		handle->user = &users[i];
-		handle->handle = curl_easy_init();
+		handle->userIndices = userIndices;
+		handle->priority = priority;
+		handle->order = userIndices.front();
+		handle->queued = Clock::now();
+
+		if (options.replay)
+		{
+			for (auto userIndex : userIndices)
+			{
+				handle->replayed.push_back(NextRecording(userIndex));
+			}
 
-		auto &player = players[i];
-		users[i].steamID = player.steamID;
-		users[i].playedTime = player.time;
+			handles.push_back(std::move(handle));
+			return handles.back().get();
+		}
 
-		if (handle->handle)
+		handle->handle = curl_easy_init();
+		if (!handle->handle)
 		{
-			auto url = "https://api-public.cs-prod.leetify.com/v2/profiles/" +
-			           std::to_string(player.steamID.ConvertToUint64());
+			return nullptr;
+		}
+
+		std::string url;
 
-			curl_easy_setopt(handle->handle, CURLOPT_USERAGENT,
-			                 "CS2 Player Fetcher (+https://github.com/Poggicek/CS2-Player-Fetcher)");
-			curl_easy_setopt(handle->handle, CURLOPT_TIMEOUT, 60L);
-			curl_easy_setopt(handle->handle, CURLOPT_URL, url.c_str());
-			curl_easy_setopt(handle->handle, CURLOPT_WRITEFUNCTION, WriteCallback);
-			curl_easy_setopt(handle->handle, CURLOPT_WRITEDATA, &handle->response);
-			curl_easy_setopt(handle->handle, CURLOPT_PRIVATE, handle.get());
+		if (Batching())
+		{
+			url = options.batchEndpoint + (options.batchEndpoint.find('?') == std::string::npos ? "?ids=" : "&ids=");
 
-			curl_multi_add_handle(multiHandle, handle->handle);
+			for (auto userIndex : userIndices)
+			{
+				url += std::to_string(steamIDs[userIndex].ConvertToUint64()) +
+				       (userIndex != userIndices.back() ? "," : "");
+			}
 
-			handles[i] = std::move(handle);
+			// Combined responses are large and compress well
+			curl_easy_setopt(handle->handle, CURLOPT_ACCEPT_ENCODING, "");
 		}
 		else
 		{
-			printf("fail: %llu - failed to initialize cURL handle\n", player.steamID.ConvertToUint64());
+			url = "https://api-public.cs-prod.leetify.com/v2/profiles/" +
+			      std::to_string(steamIDs[userIndices.front()].ConvertToUint64());
+		}
+
+		curl_easy_setopt(handle->handle, CURLOPT_USERAGENT,
+		                 "CS2 Player Fetcher (+https://github.com/Poggicek/CS2-Player-Fetcher)");
+		curl_easy_setopt(handle->handle, CURLOPT_TIMEOUT, 60L);
+		curl_easy_setopt(handle->handle, CURLOPT_URL, url.c_str());
+		curl_easy_setopt(handle->handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+		curl_easy_setopt(handle->handle, CURLOPT_WRITEDATA, &handle->response);
+		curl_easy_setopt(handle->handle, CURLOPT_PRIVATE, handle.get());
+
+		if (options.onTransfer)
+		{
+			curl_easy_setopt(handle->handle, CURLOPT_HEADERFUNCTION, WriteCallback);
+			curl_easy_setopt(handle->handle, CURLOPT_HEADERDATA, &handle->headers);
 		}
+
+		handles.push_back(std::move(handle));
+		return handles.back().get();
+	}
+
+	// Queues a user to be sent as part of the next batch of its priority
+	void QueueForBatch(size_t userIndex, FetchPriority priority)
+	{
+		auto handle = std::make_unique<CurlHandle>();
+		handle->userIndices = {userIndex};
+		handle->placeholder = true;
+		handle->priority = priority;
+		handle->order = userIndex;
+		handle->queued = Clock::now();
+
+		pending.push(handle.get());
+		handles.push_back(std::move(handle));
 	}
 
-	int stillRunning = 0;
-	do
+	// Groups queued users of the same priority into one transfer, once the batch is full or the oldest user in it
+	// has lingered long enough. Returns null and leaves everything queued while the batch is still filling up.
+	CurlHandle *TakeBatch(CurlHandle *first)
 	{
-		CURLMcode mc = curl_multi_perform(multiHandle, &stillRunning);
-		if (mc == CURLM_OK)
+		std::vector<CurlHandle *> members = {first};
+		auto maxBatchSize = (std::max)(options.maxBatchSize, size_t(1));
+
+		while (members.size() < maxBatchSize && !pending.empty() && pending.top()->placeholder &&
+		       pending.top()->priority == first->priority)
 		{
-			mc = curl_multi_poll(multiHandle, nullptr, 0, 1000, nullptr);
+			members.push_back(pending.top());
+			pending.pop();
 		}
 
-		if (mc != CURLM_OK)
+		auto oldest = first->queued;
+		for (auto member : members)
 		{
-			break;
+			oldest = (std::min)(oldest, member->queued);
 		}
 
-		CURLMsg *msg;
-		int msgsLeft;
-		while ((msg = curl_multi_info_read(multiHandle, &msgsLeft)))
+		if (members.size() < maxBatchSize && Clock::now() - oldest < options.batchLinger)
 		{
-			if (msg->msg != CURLMSG_DONE)
+			for (auto member : members)
 			{
-				continue;
+				pending.push(member);
 			}
 
-			CurlHandle *handle;
-			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &handle);
+			return nullptr;
+		}
 
-			auto user = handle->user;
+		std::vector<size_t> userIndices;
+		for (auto member : members)
+		{
+			member->finished = true;
+			userIndices.push_back(member->userIndices.front());
+		}
 
-			if (msg->data.result != CURLE_OK)
+		auto batch = CreateHandle(userIndices, first->priority);
+		if (!batch)
+		{
+			for (auto userIndex : userIndices)
 			{
-				printf("fail: %llu - cURL error %d\n", user->steamID.ConvertToUint64(), msg->data.result);
-				continue;
+				Log("fail: %llu - failed to initialize cURL handle", steamIDs[userIndex].ConvertToUint64());
+				Resolve(userIndex);
+			}
+		}
+
+		return batch;
+	}
+
+	bool HasWork() const
+	{
+		return !active.empty() || !pending.empty();
+	}
+
+	void Deactivate(CurlHandle *handle)
+	{
+		if (handle->handle)
+		{
+			curl_multi_remove_handle(multiHandle, handle->handle);
+		}
+		std::erase(active, handle);
+	}
+
+	bool Superseded(CurlHandle *handle)
+	{
+		return std::all_of(handle->userIndices.begin(), handle->userIndices.end(),
+		                   [this](size_t userIndex) { return dropped[userIndex]; });
+	}
+
+	void DropUsers(CurlHandle *handle)
+	{
+		handle->finished = true;
+
+		{
+			std::lock_guard lock(mutex);
+
+			for (auto userIndex : handle->userIndices)
+			{
+				users[userIndex].pending = false;
 			}
+		}
 
-			int response_code;
-			curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &response_code);
+		resolved.notify_all();
+	}
 
-			if (response_code != 200)
+	template <typename Predicate> void DropPending(Predicate shouldDrop)
+	{
+		std::vector<CurlHandle *> kept;
+		while (!pending.empty())
+		{
+			if (!shouldDrop(pending.top()))
 			{
-				if (response_code != 404)
-				{
-					printf("fail: %llu - Leetify error HTTP %d\n", user->steamID.ConvertToUint64(), response_code);
-				}
-				continue;
+				kept.push_back(pending.top());
 			}
+			pending.pop();
+		}
 
-			try
+		for (auto handle : kept)
+		{
+			pending.push(handle);
+		}
+	}
+
+	void Cancel(CurlHandle *handle)
+	{
+		handle->finished = true;
+
+		if (std::find(active.begin(), active.end(), handle) != active.end())
+		{
+			Deactivate(handle);
+		}
+		else
+		{
+			DropPending([handle](CurlHandle *other) { return other == handle; });
+		}
+	}
+
+	void Log(const char *format, ...)
+	{
+		char message[512];
+
+		va_list args;
+		va_start(args, format);
+		vsnprintf(message, sizeof(message), format, args);
+		va_end(args);
+
+		if (options.onLog)
+		{
+			options.onLog(message);
+		}
+		else
+		{
+			printf("%s\n", message);
+		}
+	}
+
+	// Publishes a user's outcome, the decoded profile if there is one, and reports it
+	void Resolve(size_t userIndex, LeetifyUser *result = nullptr)
+	{
+		LeetifyUser user;
+		bool report;
+
+		{
+			std::lock_guard lock(mutex);
+			auto &stored = users[userIndex];
+
+			if (result)
 			{
-				auto json = nlohmann::json::parse(handle->response);
+				result->playedTime = stored.playedTime;
+				stored = std::move(*result);
+			}
 
-				user->name = getValue(json, "name", std::string(""));
-				user->winRate = getValue(json, "winrate", 0.0f) * 100.0f;
-				user->totalMatches = getValue(json, "total_matches", 0);
+			stored.pending = false;
+			report = !stopping && options.onResult;
 
-				if (json.contains("first_match_date") && json["first_match_date"].is_string())
-				{
-					std::istringstream iss(json["first_match_date"].get<std::string>());
-					std::chrono::from_stream(iss, "%Y-%m-%dT%H:%M:%S%Z", user->firstMatchDate);
-				}
+			if (report)
+			{
+				user = stored;
+			}
+		}
 
-				if (json.contains("rating") && json["rating"].is_object())
-				{
-					auto &rating = json["rating"];
-					user->rating.aim = getValue(rating, "aim", 0.0f);
-					user->rating.positioning = getValue(rating, "positioning", 0.0f);
-					user->rating.utility = getValue(rating, "utility", 0.0f);
-					user->rating.clutch = getValue(rating, "clutch", 0.0f);
-					user->rating.opening = getValue(rating, "opening", 0.0f);
-					user->rating.ct_leetify = getValue(rating, "ct_leetify", 0.0f);
-					user->rating.t_leetify = getValue(rating, "t_leetify", 0.0f);
-				}
+		resolved.notify_all();
 
-				if (json.contains("ranks") && json["ranks"].is_object())
-				{
-					auto &ranks = json["ranks"];
-					user->ranks.leetify = getValue(ranks, "leetify", 0.0f);
-					user->ranks.premier = getValue(ranks, "premier", 0);
-					user->ranks.faceit = getValue(ranks, "faceit_elo", 0);
-				}
+		// Called without the lock so the callback can submit more players or take its own locks
+		if (report)
+		{
+			options.onResult(user);
+		}
+	}
+
+	// Moves queued handles onto the multi handle, preempting lower priority transfers when at the cap
+	void AdmitPending()
+	{
+		while (!pending.empty())
+		{
+			auto next = pending.top();
 
-				if (json.contains("stats") && json["stats"].is_object())
+			if (next->placeholder)
+			{
+				pending.pop();
+				next = TakeBatch(next);
+
+				if (!next)
 				{
-					auto &skills = json["stats"];
-					user->skills.accuracy_enemy_spotted = getValue(skills, "accuracy_enemy_spotted", 0.0f);
-					user->skills.accuracy_head = getValue(skills, "accuracy_head", 0.0f);
-					user->skills.counter_strafing_good_shots_ratio =
-					    getValue(skills, "counter_strafing_good_shots_ratio", 0.0f);
-					user->skills.ct_opening_aggression_success_rate =
-					    getValue(skills, "ct_opening_aggression_success_rate", 0.0f);
-					user->skills.ct_opening_duel_success_percentage =
-					    getValue(skills, "ct_opening_duel_success_percentage", 0.0f);
-					user->skills.flashbang_hit_foe_avg_duration =
-					    getValue(skills, "flashbang_hit_foe_avg_duration", 0.0f);
-					user->skills.flashbang_hit_foe_per_flashbang =
-					    getValue(skills, "flashbang_hit_foe_per_flashbang", 0.0f);
-					user->skills.flashbang_hit_friend_per_flashbang =
-					    getValue(skills, "flashbang_hit_friend_per_flashbang", 0.0f);
-					user->skills.flashbang_leading_to_kill = getValue(skills, "flashbang_leading_to_kill", 0.0f);
-					user->skills.flashbang_thrown = getValue(skills, "flashbang_thrown", 0.0f);
-					user->skills.he_foes_damage_avg = getValue(skills, "he_foes_damage_avg", 0.0f);
-					user->skills.he_friends_damage_avg = getValue(skills, "he_friends_damage_avg", 0.0f);
-					user->skills.preaim = getValue(skills, "preaim", 0.0f);
-					user->skills.reaction_time = getValue(skills, "reaction_time_ms", 0.0f);
-					user->skills.spray_accuracy = getValue(skills, "spray_accuracy", 0.0f);
-					user->skills.t_opening_aggression_success_rate =
-					    getValue(skills, "t_opening_aggression_success_rate", 0.0f);
-					user->skills.t_opening_duel_success_percentage =
-					    getValue(skills, "t_opening_duel_success_percentage", 0.0f);
-					user->skills.traded_deaths_success_percentage =
-					    getValue(skills, "traded_deaths_success_percentage", 0.0f);
-					user->skills.trade_kill_opportunities_per_round =
-					    getValue(skills, "trade_kill_opportunities_per_round", 0.0f);
-					user->skills.trade_kills_success_percentage =
-					    getValue(skills, "trade_kills_success_percentage", 0.0f);
-					user->skills.utility_on_death_avg = getValue(skills, "utility_on_death_avg", 0.0f);
+					break;
 				}
 
-				if (json.contains("bans") && json["bans"].is_array())
+				pending.push(next);
+			}
+
+			if (active.size() >= maxActive)
+			{
+				auto victim = *std::max_element(active.begin(), active.end(), [](CurlHandle *a, CurlHandle *b) {
+					return PendingOrder()(b, a);
+				});
+
+				if (victim->priority <= next->priority)
 				{
-					for (const auto &ban : json["bans"])
-					{
-						user->bans.push_back(getValue(ban, "platform", std::string("")));
-					}
+					break;
 				}
 
-				if (json.contains("recent_teammates") && json["recent_teammates"].is_array())
-				{
-					for (const auto &teammate : json["recent_teammates"])
-					{
-						auto steam64_id = std::stoull(getValue(teammate, "steam64_id", std::string("0")));
-						auto matchCount = getValue(teammate, "recent_matches_count", 0);
+				// Removing an easy handle aborts its transfer, it starts over once it is admitted again
+				Deactivate(victim);
+				victim->response.clear();
+				victim->headers.clear();
+				pending.push(victim);
+			}
 
-						user->recentTeammates.emplace_back(CSteamID(steam64_id), matchCount);
-					}
-				}
+			pending.pop();
+			next->started = Clock::now();
+			active.push_back(next);
 
-				user->success = true;
+			if (options.replay)
+			{
+				next->due = next->started + ReplayLatency(next);
 			}
-			catch (const std::exception &e)
+			else
 			{
-				printf("fail: %llu - error %s\n", user->steamID.ConvertToUint64(), e.what());
+				curl_multi_add_handle(multiHandle, next->handle);
 			}
+		}
+	}
+
+	// Drops everything whose result no longer matters, e.g. because the coplay set changed. A batch keeps going
+	// as long as one of its players is still wanted.
+	void CancelSuperseded()
+	{
+		if (std::none_of(dropped.begin(), dropped.end(), [](bool isDropped) { return isDropped; }))
+		{
+			return;
+		}
 
-			curl_multi_remove_handle(multiHandle, msg->easy_handle);
+		for (auto handle : std::vector<CurlHandle *>(active))
+		{
+			if (Superseded(handle))
+			{
+				Deactivate(handle);
+				DropUsers(handle);
+			}
 		}
-	} while (stillRunning);
 
-	for (auto &handle : handles)
+		DropPending([this](CurlHandle *handle) {
+			if (!Superseded(handle))
+			{
+				return false;
+			}
+
+			DropUsers(handle);
+			return true;
+		});
+	}
+
+	// Races a duplicate against every transfer that has been running for longer than the observed p95
+	void HedgeSlowTransfers()
 	{
-		curl_easy_cleanup(handle->handle);
+		auto p95 = s_latencies.Percentile(0.95);
+		if (!p95)
+		{
+			return;
+		}
+
+		auto now = Clock::now();
+		for (auto handle : active)
+		{
+			if (handle->hedge || now - handle->started < *p95)
+			{
+				continue;
+			}
+
+			auto duplicate = CreateHandle(handle->userIndices, handle->priority);
+			if (!duplicate)
+			{
+				continue;
+			}
+
+			duplicate->hedge = handle;
+			handle->hedge = duplicate;
+			pending.push(duplicate);
+		}
 	}
 
-	curl_multi_cleanup(multiHandle);
-	curl_global_cleanup();
+	// How long to wait for socket activity before the next hedge, batch or replayed transfer is due
+	Clock::duration PollTimeout()
+	{
+		auto now = Clock::now();
+		Clock::duration timeout = std::chrono::seconds(1);
 
-	return users;
+		// Batches that are still filling up are flushed once they have lingered long enough
+		if (!pending.empty() && pending.top()->placeholder)
+		{
+			timeout = (std::min)(timeout, pending.top()->queued + options.batchLinger - now);
+		}
+
+		for (auto handle : active)
+		{
+			if (options.replay)
+			{
+				timeout = (std::min)(timeout, handle->due - now);
+			}
+		}
+
+		if (auto p95 = s_latencies.Percentile(0.95))
+		{
+			for (auto handle : active)
+			{
+				if (!handle->hedge)
+				{
+					timeout = (std::min)(timeout, handle->started + *p95 - now);
+				}
+			}
+		}
+
+		return (std::max)(timeout, Clock::duration::zero());
+	}
+
+	void Complete(CurlHandle *handle, CURLcode result, long responseCode)
+	{
+		Deactivate(handle);
+		handle->finished = true;
+
+		auto now = Clock::now();
+
+		// Batched transfers are recorded per user once the combined response is split up
+		if (options.onTransfer && !Batching())
+		{
+			options.onTransfer({steamIDs[handle->userIndices.front()], result, responseCode, handle->headers,
+			                    handle->response,
+			                    std::chrono::duration_cast<std::chrono::milliseconds>(handle->started - origin),
+			                    std::chrono::duration_cast<std::chrono::milliseconds>(now - handle->started)});
+		}
+
+		auto hedgeRunning = handle->hedge && !handle->hedge->finished;
+
+		if (result != CURLE_OK)
+		{
+			// The other copy of a hedged transfer may still succeed
+			if (hedgeRunning)
+			{
+				return;
+			}
+		}
+		else
+		{
+			if (hedgeRunning)
+			{
+				Cancel(handle->hedge);
+			}
+
+			s_latencies.Add(now - handle->started);
+		}
+
+		if (Batching())
+		{
+			DeliverBatch(handle, result, responseCode, now);
+		}
+		else
+		{
+			Deliver(handle->userIndices.front(), result, responseCode, std::move(handle->response));
+		}
+	}
+
+	// Splits a combined response of the form {"profiles": {"<steam64>": {...}}, "errors": {"<steam64>": <status>}}
+	void DeliverBatch(CurlHandle *handle, CURLcode result, long responseCode, Clock::time_point now)
+	{
+		auto startOffset = std::chrono::duration_cast<std::chrono::milliseconds>(handle->started - origin);
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - handle->started);
+
+		if (result != CURLE_OK || responseCode != 200)
+		{
+			for (auto userIndex : handle->userIndices)
+			{
+				if (options.onTransfer)
+				{
+					options.onTransfer(
+					    {steamIDs[userIndex], result, responseCode, handle->headers, "", startOffset, elapsed});
+				}
+
+				Deliver(userIndex, result, responseCode, "");
+			}
+			return;
+		}
+
+		std::vector<CSteamID> batchSteamIDs;
+		for (auto userIndex : handle->userIndices)
+		{
+			batchSteamIDs.push_back(steamIDs[userIndex]);
+		}
+
+		decoding.Add();
+		WorkerPool::Shared().Submit([this, userIndices = handle->userIndices, batchSteamIDs = std::move(batchSteamIDs),
+		                             body = std::move(handle->response), headers = handle->headers, startOffset,
+		                             elapsed]() {
+			nlohmann::json json;
+
+			try
+			{
+				json = nlohmann::json::parse(body);
+			}
+			catch (const std::exception &e)
+			{
+				for (size_t i = 0; i < userIndices.size(); i++)
+				{
+					Log("fail: %llu - error %s", batchSteamIDs[i].ConvertToUint64(), e.what());
+					Resolve(userIndices[i]);
+				}
+
+				decoding.Done();
+				return;
+			}
+
+			auto &profiles = json.contains("profiles") ? json["profiles"] : json;
+			auto errors = json.contains("errors") ? json["errors"] : nlohmann::json::object();
+
+			for (size_t i = 0; i < userIndices.size(); i++)
+			{
+				auto steamID = batchSteamIDs[i];
+				auto key = std::to_string(steamID.ConvertToUint64());
+				auto found = profiles.contains(key) && profiles[key].is_object();
+				long status = found ? 200 : getValue(errors, key, 404L);
+				std::optional<LeetifyUser> user;
+
+				if (found)
+				{
+					try
+					{
+						user.emplace();
+						user->steamID = steamID;
+						ParseLeetifyUser(profiles[key], &*user);
+					}
+					catch (const std::exception &e)
+					{
+						Log("fail: %llu - error %s", steamID.ConvertToUint64(), e.what());
+						user.reset();
+					}
+				}
+				else if (status != 404)
+				{
+					Log("fail: %llu - Leetify error HTTP %ld", steamID.ConvertToUint64(), status);
+				}
+
+				if (options.onTransfer)
+				{
+					options.onTransfer(
+					    {steamID, CURLE_OK, status, headers, found ? profiles[key].dump() : "", startOffset, elapsed});
+				}
+
+				Resolve(userIndices[i], user ? &*user : nullptr);
+			}
+
+			decoding.Done();
+		});
+	}
+
+	// Turns a finished transfer, live or replayed, into a resolved user
+	void Deliver(size_t userIndex, int result, long responseCode, std::string body)
+	{
+		auto steamID = steamIDs[userIndex];
+
+		if (result != CURLE_OK)
+		{
+			Log("fail: %llu - cURL error %d", steamID.ConvertToUint64(), result);
+			Resolve(userIndex);
+			return;
+		}
+
+		if (responseCode != 200)
+		{
+			if (responseCode != 404)
+			{
+				Log("fail: %llu - Leetify error HTTP %ld", steamID.ConvertToUint64(), responseCode);
+			}
+			Resolve(userIndex);
+			return;
+		}
+
+		// Decoding happens on the worker pool so this thread can keep servicing sockets
+		decoding.Add();
+		WorkerPool::Shared().Submit([this, userIndex, steamID, body = std::move(body)]() {
+			LeetifyUser user;
+			user.steamID = steamID;
+
+			try
+			{
+				ParseLeetifyUser(body, &user);
+				Resolve(userIndex, &user);
+			}
+			catch (const std::exception &e)
+			{
+				Log("fail: %llu - error %s", steamID.ConvertToUint64(), e.what());
+				Resolve(userIndex);
+			}
+
+			decoding.Done();
+		});
+	}
+
+	// Groups the recording by player, a player has more than one transfer if it was hedged or preempted
+	void LoadRecordings()
+	{
+		for (const auto &transfer : *options.replay)
+		{
+			recordings[transfer.steamID.ConvertToUint64()].push_back(&transfer);
+		}
+
+		for (auto &[steamID, recording] : recordings)
+		{
+			std::stable_sort(recording.begin(), recording.end(), [](const TransferRecord *a, const TransferRecord *b) {
+				return a->startOffset < b->startOffset;
+			});
+		}
+	}
+
+	// Every attempt at a user, hedges and restarts after preemption included, plays back the next recorded transfer,
+	// the last one is reused once they run out
+	const TransferRecord *NextRecording(size_t userIndex)
+	{
+		auto steamID = steamIDs[userIndex].ConvertToUint64();
+		const auto &recording = recordings[steamID];
+		auto attempt = (std::min)(replayAttempts[steamID]++, recording.size() - 1);
+		return recording[attempt];
+	}
+
+	// A batch takes as long as its slowest member did
+	Clock::duration ReplayLatency(const CurlHandle *handle)
+	{
+		auto speed = options.replaySpeed > 0.0 ? options.replaySpeed : 1.0;
+		std::chrono::milliseconds elapsed{0};
+
+		for (auto transfer : handle->replayed)
+		{
+			elapsed = (std::max)(elapsed, transfer->elapsed);
+		}
+
+		return std::chrono::duration_cast<Clock::duration>(elapsed / speed);
+	}
+
+	// Lands every replayed transfer that is due, returns whether any did
+	bool CompleteReplayed()
+	{
+		auto now = Clock::now();
+		auto completed = false;
+
+		for (auto handle : std::vector<CurlHandle *>(active))
+		{
+			if (handle->finished || handle->due > now)
+			{
+				continue;
+			}
+
+			completed = true;
+			handle->headers = handle->replayed.front()->headers;
+
+			if (!Batching())
+			{
+				handle->response = handle->replayed.front()->body;
+				Complete(handle, static_cast<CURLcode>(handle->replayed.front()->curlResult),
+				         handle->replayed.front()->responseCode);
+				continue;
+			}
+
+			// Rebuilds the combined response the batch endpoint would have sent for these users
+			auto failed = std::find_if(handle->replayed.begin(), handle->replayed.end(),
+			                           [](const TransferRecord *transfer) { return transfer->curlResult != CURLE_OK; });
+			if (failed != handle->replayed.end())
+			{
+				Complete(handle, static_cast<CURLcode>((*failed)->curlResult), 0);
+				continue;
+			}
+
+			std::string profiles, errors;
+			for (auto transfer : handle->replayed)
+			{
+				auto key = "\"" + std::to_string(transfer->steamID.ConvertToUint64()) + "\":";
+
+				if (transfer->responseCode == 200)
+				{
+					profiles += (profiles.empty() ? "" : ",") + key + transfer->body;
+				}
+				else
+				{
+					errors += (errors.empty() ? "" : ",") + key + std::to_string(transfer->responseCode);
+				}
+			}
+
+			handle->response = "{\"profiles\":{" + profiles + "},\"errors\":{" + errors + "}}";
+			Complete(handle, CURLE_OK, 200);
+		}
+
+		return completed;
+	}
+
+	// Moves a player's queued transfers up to a higher priority. Running ones keep going, they are only less
+	// likely to be preempted from now on.
+	void Raise(size_t userIndex, FetchPriority priority)
+	{
+		auto raise = [userIndex, priority](CurlHandle *handle) {
+			return handle->priority > priority && std::find(handle->userIndices.begin(), handle->userIndices.end(),
+			                                                userIndex) != handle->userIndices.end();
+		};
+
+		std::vector<CurlHandle *> raised;
+		DropPending([&](CurlHandle *handle) {
+			if (!raise(handle))
+			{
+				return false;
+			}
+
+			raised.push_back(handle);
+			return true;
+		});
+
+		for (auto handle : raised)
+		{
+			handle->priority = priority;
+			pending.push(handle);
+		}
+
+		for (auto handle : active)
+		{
+			if (raise(handle))
+			{
+				handle->priority = priority;
+			}
+		}
+	}
+
+	// Starts fetching a player picked up from submitted, called with the lock held. A player submitted before only
+	// has its priority raised and its coplay time updated, unless it was cancelled, then it is fetched again.
+	void Queue(const Player &player)
+	{
+		auto steamID = player.steamID.ConvertToUint64();
+		auto existing = userIndices.find(steamID);
+
+		if (existing != userIndices.end())
+		{
+			auto userIndex = existing->second;
+			users[userIndex].playedTime = player.time;
+
+			if (!dropped[userIndex])
+			{
+				Raise(userIndex, player.priority);
+				return;
+			}
+
+			dropped[userIndex] = false;
+			Fetch(userIndex, player.priority);
+			return;
+		}
+
+		auto userIndex = users.size();
+		users.emplace_back();
+		users.back().steamID = player.steamID;
+		users.back().playedTime = player.time;
+		steamIDs.push_back(player.steamID);
+		dropped.push_back(false);
+		userIndices.emplace(steamID, userIndex);
+
+		Fetch(userIndex, player.priority);
+	}
+
+	void Fetch(size_t userIndex, FetchPriority priority)
+	{
+		auto steamID = steamIDs[userIndex].ConvertToUint64();
+
+		if (options.replay ? !recordings.contains(steamID) : !multiHandle)
+		{
+			Log("fail: %llu - %s", steamID, options.replay ? "not in the recording" : "no cURL multi handle");
+		}
+		else if (Batching())
+		{
+			users[userIndex].pending = true;
+			QueueForBatch(userIndex, priority);
+		}
+		else if (auto handle = CreateHandle({userIndex}, priority))
+		{
+			users[userIndex].pending = true;
+			pending.push(handle);
+		}
+		else
+		{
+			Log("fail: %llu - failed to initialize cURL handle", steamID);
+		}
+	}
+
+	// Marks players picked up from cancelled, called with the lock held
+	void Drop(CSteamID steamID)
+	{
+		auto it = userIndices.find(steamID.ConvertToUint64());
+		if (it != userIndices.end() && users[it->second].pending)
+		{
+			dropped[it->second] = true;
+		}
+	}
+
+	// Frees transfers that are done with, a long-running fetch would otherwise keep every one it ever made
+	void Reap()
+	{
+		// Decided before anything is freed, erasing moves handles over each other and a hedge may point at either
+		std::vector<CurlHandle *> done;
+		for (const auto &handle : handles)
+		{
+			if (handle->finished && (!handle->hedge || handle->hedge->finished))
+			{
+				done.push_back(handle.get());
+			}
+		}
+
+		for (auto handle : done)
+		{
+			handle->hedge = nullptr;
+			handle->reaped = true;
+
+			if (handle->handle)
+			{
+				curl_easy_cleanup(handle->handle);
+				handle->handle = nullptr;
+			}
+		}
+
+		std::erase_if(handles, [](const std::unique_ptr<CurlHandle> &handle) { return handle->reaped; });
+	}
+
+	// Interrupts the fetch thread's wait for sockets or replayed transfers
+	void Wake()
+	{
+		wake.notify_all();
+
+		if (multiHandle)
+		{
+			curl_multi_wakeup(multiHandle);
+		}
+	}
+
+	// Runs on the fetch thread until stopped, sleeping while there is nothing to do
+	void Run()
+	{
+		while (true)
+		{
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [this] { return stopping || !submitted.empty() || !cancelled.empty() || HasWork(); });
+
+				if (stopping)
+				{
+					break;
+				}
+
+				for (const auto &player : submitted)
+				{
+					Queue(player);
+				}
+				submitted.clear();
+
+				for (auto steamID : cancelled)
+				{
+					Drop(steamID);
+				}
+				cancelled.clear();
+			}
+
+			resolved.notify_all();
+			Reap();
+
+			CancelSuperseded();
+			HedgeSlowTransfers();
+			AdmitPending();
+
+			// Recorded transfers go through the same scheduling, only the network is simulated
+			if (options.replay)
+			{
+				if (!CompleteReplayed())
+				{
+					std::unique_lock lock(mutex);
+					wake.wait_for(lock, PollTimeout(),
+					              [this] { return stopping || !submitted.empty() || !cancelled.empty(); });
+				}
+				continue;
+			}
+
+			int stillRunning = 0;
+			CURLMcode mc = curl_multi_perform(multiHandle, &stillRunning);
+			if (mc == CURLM_OK)
+			{
+				auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(PollTimeout());
+				mc = curl_multi_poll(multiHandle, nullptr, 0, static_cast<int>(timeout.count()), nullptr);
+			}
+
+			if (mc != CURLM_OK)
+			{
+				Log("cURL multi error %d", mc);
+				break;
+			}
+
+			CURLMsg *msg;
+			int msgsLeft;
+			while ((msg = curl_multi_info_read(multiHandle, &msgsLeft)))
+			{
+				if (msg->msg != CURLMSG_DONE)
+				{
+					continue;
+				}
+
+				CurlHandle *handle;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &handle);
+
+				long responseCode = 0;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &responseCode);
+
+				Complete(handle, msg->data.result, responseCode);
+			}
+		}
+
+		// Whatever is still queued or in flight is abandoned, decoding already under way is let to finish
+		for (auto handle : std::vector<CurlHandle *>(active))
+		{
+			Deactivate(handle);
+		}
+
+		decoding.Wait();
+
+		{
+			std::lock_guard lock(mutex);
+
+			for (auto &user : users)
+			{
+				user.pending = false;
+			}
+		}
+
+		resolved.notify_all();
+	}
+};
+
+LeetifyFetch::LeetifyFetch(const FetchOptions &options) : session(std::make_unique<FetchSession>(options))
+{
+	thread = std::thread([session = session.get()]() { session->Run(); });
+}
+
+LeetifyFetch::~LeetifyFetch()
+{
+	Stop();
+}
+
+void LeetifyFetch::Submit(const std::vector<Player> &players)
+{
+	{
+		std::lock_guard lock(session->mutex);
+		session->submitted.insert(session->submitted.end(), players.begin(), players.end());
+	}
+
+	session->Wake();
+}
+
+void LeetifyFetch::Cancel(const std::vector<CSteamID> &steamIDs)
+{
+	{
+		std::lock_guard lock(session->mutex);
+		session->cancelled.insert(session->cancelled.end(), steamIDs.begin(), steamIDs.end());
+	}
+
+	session->Wake();
+}
+
+// Called with the lock held. Players not picked up by the fetch thread yet are reported as pending, and with the
+// coplay time they were submitted with.
+static std::vector<LeetifyUser> CopyUsers(const FetchSession &session, const std::vector<CSteamID> &steamIDs)
+{
+	std::vector<LeetifyUser> users;
+
+	for (auto steamID : steamIDs)
+	{
+		auto &user = users.emplace_back();
+		user.steamID = steamID;
+
+		auto it = session.userIndices.find(steamID.ConvertToUint64());
+		if (it != session.userIndices.end())
+		{
+			user = session.users[it->second];
+		}
+
+		auto submitted = std::find_if(session.submitted.rbegin(), session.submitted.rend(),
+		                              [steamID](const Player &player) { return player.steamID == steamID; });
+		if (submitted != session.submitted.rend())
+		{
+			user.playedTime = static_cast<int>(submitted->time);
+			user.pending = user.pending || it == session.userIndices.end();
+		}
+	}
+
+	return users;
+}
+
+std::vector<LeetifyUser> LeetifyFetch::Users(const std::vector<CSteamID> &steamIDs)
+{
+	std::lock_guard lock(session->mutex);
+	return CopyUsers(*session, steamIDs);
+}
+
+std::chrono::milliseconds LeetifyFetch::Elapsed() const
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - session->origin);
+}
+
+std::vector<LeetifyUser> LeetifyFetch::Wait(const std::vector<CSteamID> &steamIDs)
+{
+	std::unique_lock lock(session->mutex);
+
+	auto done = [this, &steamIDs]() {
+		return std::all_of(steamIDs.begin(), steamIDs.end(), [this](CSteamID steamID) {
+			auto it = session->userIndices.find(steamID.ConvertToUint64());
+			return it != session->userIndices.end() && !session->users[it->second].pending;
+		});
+	};
+
+	if (session->options.deadline.count() > 0)
+	{
+		session->resolved.wait_for(lock, session->options.deadline, done);
+	}
+	else
+	{
+		session->resolved.wait(lock, done);
+	}
+
+	// Past the deadline, whatever is still in flight keeps going and is reported as it lands
+	auto users = CopyUsers(*session, steamIDs);
+	lock.unlock();
+
+	if (!session->options.onResult)
+	{
+		Stop();
+
+		for (auto &user : users)
+		{
+			user.pending = false;
+		}
+	}
+
+	return users;
+}
+
+void LeetifyFetch::Stop()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard lock(session->mutex);
+		session->stopping = true;
+	}
+
+	session->Wake();
+	thread.join();
 }
@@ -2,15 +2,29 @@
 
 #include "steam_api.h"
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
+// Lower values are fetched first
+enum class FetchPriority
+{
+	CurrentLobby,
+	Self,
+	TeammateExpansion,
+	BackgroundRefresh,
+};
+
 struct Player
 {
 	CSteamID steamID;
 	long long time;
+	FetchPriority priority;
 
-	Player(CSteamID playerSteamID, long long iTimeStamp) : steamID(playerSteamID), time(iTimeStamp)
+	Player(CSteamID playerSteamID, long long iTimeStamp, FetchPriority fetchPriority = FetchPriority::CurrentLobby)
+	    : steamID(playerSteamID), time(iTimeStamp), priority(fetchPriority)
 	{
 	}
 };
@@ -18,6 +32,7 @@ struct Player
 struct LeetifyUser
 {
 	bool success = false;
+	bool pending = false; // still being fetched after the deadline
 	float winRate = 0.0f;
 	int lobbyID = 0;
 	int totalMatches = -1;
@@ -84,4 +99,85 @@ struct LeetifyUser
 	} skills;
 };
 
-std::vector<LeetifyUser> GetLeetifyUsers(const std::vector<Player> &steamIDs);
+// One finished transfer as seen by the network thread, enough to play it back later
+struct TransferRecord
+{
+	CSteamID steamID;
+	int curlResult;
+	long responseCode;
+	std::string headers;
+	std::string body;
+	std::chrono::milliseconds startOffset; // since the fetch began
+	std::chrono::milliseconds elapsed;
+};
+
+struct FetchOptions
+{
+	// Transfers allowed in flight at once, once reached lower priorities are preempted by higher ones
+	int maxConcurrentTransfers = 16;
+
+	// Wait returns partial results once this passes, zero waits for every transfer
+	std::chrono::milliseconds deadline{0};
+
+	// Receives every player as their result lands, called from the fetch thread or a worker thread. Without it the
+	// fetch is stopped once Wait returns.
+	std::function<void(const LeetifyUser &)> onResult;
+
+	// Groups profiles into requests to this endpoint as ?ids=<steam64>,<steam64>,... instead of fetching them one by
+	// one, a batch is sent once it is full or its oldest profile has waited for batchLinger
+	std::string batchEndpoint;
+	size_t maxBatchSize = 32;
+	std::chrono::milliseconds batchLinger{5};
+
+	// Receives every finished transfer, per profile for batched requests, called from the network or a worker thread
+	std::function<void(const TransferRecord &)> onTransfer;
+
+	// Receives failure messages instead of stdout, so a caller drawing the console can place them. Called from the
+	// fetch thread or a worker thread.
+	std::function<void(const std::string &)> onLog;
+
+	// Serves responses from a recording instead of the network, replaySpeed > 1 plays it back faster
+	const std::vector<TransferRecord> *replay = nullptr;
+	double replaySpeed = 1.0;
+};
+
+// Decodes one profile response the way fetched ones are, throws on malformed JSON
+void ParseLeetifyUser(const std::string &body, LeetifyUser *user);
+
+struct FetchSession;
+
+// Fetches profiles on a thread of its own, which keeps running past the deadline until the fetch is stopped or
+// destroyed. No callback runs once Stop returns.
+class LeetifyFetch
+{
+  public:
+	LeetifyFetch(const FetchOptions &options = {});
+	~LeetifyFetch();
+
+	LeetifyFetch(const LeetifyFetch &) = delete;
+	LeetifyFetch &operator=(const LeetifyFetch &) = delete;
+
+	// Queues players to be fetched, a player submitted before only has its priority raised unless it was cancelled.
+	// Safe to call from any thread, also while a fetch is running.
+	void Submit(const std::vector<Player> &players);
+
+	// Drops the transfers of players whose results no longer matter. Safe to call from any thread.
+	void Cancel(const std::vector<CSteamID> &steamIDs);
+
+	// Blocks until the given submitted players are resolved or the deadline passes, players still in flight are
+	// returned with pending set
+	std::vector<LeetifyUser> Wait(const std::vector<CSteamID> &steamIDs);
+
+	// Current state of the given players, pending if they are still being fetched
+	std::vector<LeetifyUser> Users(const std::vector<CSteamID> &steamIDs);
+
+	// Time since the fetch began, which recorded offsets are relative to
+	std::chrono::milliseconds Elapsed() const;
+
+	// Abandons every transfer still in flight and joins the fetch thread
+	void Stop();
+
+  private:
+	std::unique_ptr<FetchSession> session;
+	std::thread thread;
+};
@@ -0,0 +1,229 @@
+#include "lobby_shm.h"
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// Tells the core it is in a spin-wait without giving up the time slice, unlike a yield this is no syscall
+static void SpinPause()
+{
+#if defined(_WIN32)
+	YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+void CopyLobbyShmName(LobbyShmPlayer &player, const std::string &name)
+{
+	auto length = (std::min)(name.size(), sizeof(player.name) - 1);
+
+	// Back up to the lead byte of the sequence the cut lands in, unless the whole sequence fits
+	if (length < name.size())
+	{
+		while (length > 0 && (static_cast<unsigned char>(name[length]) & 0xC0) == 0x80)
+		{
+			length--;
+		}
+	}
+
+	std::memcpy(player.name, name.data(), length);
+	player.name[length] = '\0';
+}
+
+LobbyShmMapping::~LobbyShmMapping()
+{
+	Unmap();
+}
+
+bool LobbyShmMapping::Map(bool create, const char *name)
+{
+	constexpr auto size = sizeof(LobbyShmSegment);
+
+#ifdef _WIN32
+	auto handle = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+	                                          static_cast<DWORD>(size), name)
+	                     : OpenFileMappingA(FILE_MAP_READ, false, name);
+	if (!handle)
+	{
+		return false;
+	}
+
+	auto view = MapViewOfFile(handle, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+	if (!view)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	osHandle = handle;
+#else
+	auto fd = create ? shm_open(name, O_CREAT | O_RDWR, 0644) : shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	if (create && ftruncate(fd, size) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	auto view = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+#endif
+
+	segment = static_cast<LobbyShmSegment *>(view);
+	mappedName = name;
+	owner = create;
+	return true;
+}
+
+void LobbyShmMapping::Unmap()
+{
+	if (!segment)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(segment);
+	CloseHandle(osHandle);
+#else
+	munmap(segment, sizeof(LobbyShmSegment));
+	if (owner)
+	{
+		shm_unlink(mappedName.c_str());
+	}
+#endif
+
+	segment = nullptr;
+	osHandle = nullptr;
+}
+
+bool LobbyShmPublisher::Open(const char *name)
+{
+	if (!mapping.Map(true, name))
+	{
+		return false;
+	}
+
+	auto segment = mapping.Segment();
+	segment->magic.store(0, std::memory_order_relaxed); // readers ignore the segment until it is fully set up
+	std::atomic_thread_fence(std::memory_order_release);
+
+	new (&segment->activeSlot) std::atomic<uint32_t>(0);
+	new (&segment->generation) std::atomic<uint64_t>(0);
+	new (&segment->slots[0].sequence) std::atomic<uint64_t>(0);
+	new (&segment->slots[1].sequence) std::atomic<uint64_t>(0);
+	segment->version = LOBBY_SHM_VERSION;
+	segment->size = sizeof(LobbyShmSegment);
+
+	segment->magic.store(LOBBY_SHM_MAGIC, std::memory_order_release);
+	return true;
+}
+
+void LobbyShmPublisher::Publish(const std::vector<LobbyShmPlayer> &players)
+{
+	auto segment = mapping.Segment();
+	if (!segment)
+	{
+		return;
+	}
+
+	// Always write the slot readers are not being pointed at
+	auto slotIndex = 1 - segment->activeSlot.load(std::memory_order_relaxed);
+	auto &slot = segment->slots[slotIndex];
+	auto sequence = slot.sequence.load(std::memory_order_relaxed);
+
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	auto count = (std::min)(players.size(), LOBBY_SHM_MAX_PLAYERS);
+	slot.snapshot.publishedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                                  std::chrono::system_clock::now().time_since_epoch())
+	                                  .count();
+	slot.snapshot.playerCount = static_cast<uint32_t>(count);
+	std::memcpy(slot.snapshot.players, players.data(), count * sizeof(LobbyShmPlayer));
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	segment->activeSlot.store(slotIndex, std::memory_order_release);
+	segment->generation.fetch_add(1, std::memory_order_release);
+}
+
+bool LobbyShmReader::Open(const char *name)
+{
+	if (!mapping.Map(false, name))
+	{
+		return false;
+	}
+
+	auto segment = mapping.Segment();
+	if (segment->magic.load(std::memory_order_acquire) != LOBBY_SHM_MAGIC || segment->version != LOBBY_SHM_VERSION ||
+	    segment->size != sizeof(LobbyShmSegment))
+	{
+		mapping.Unmap();
+		return false;
+	}
+
+	return true;
+}
+
+bool LobbyShmReader::Read(LobbyShmSnapshot &out) const
+{
+	auto segment = mapping.Segment();
+	if (!segment || segment->generation.load(std::memory_order_acquire) == 0)
+	{
+		return false;
+	}
+
+	for (int attempt = 0; attempt < LOBBY_SHM_READ_RETRIES; attempt++)
+	{
+		auto &slot = segment->slots[segment->activeSlot.load(std::memory_order_acquire) & 1];
+		auto before = slot.sequence.load(std::memory_order_acquire);
+
+		// Mid-write, a live writer finishes a slot in microseconds
+		if (before & 1)
+		{
+			SpinPause();
+			continue;
+		}
+
+		std::memcpy(&out, &slot.snapshot, sizeof(out));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (slot.sequence.load(std::memory_order_relaxed) == before)
+		{
+			out.playerCount = (std::min)(out.playerCount, static_cast<uint32_t>(LOBBY_SHM_MAX_PLAYERS));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint64_t LobbyShmReader::Generation() const
+{
+	auto segment = mapping.Segment();
+	return segment ? segment->generation.load(std::memory_order_acquire) : 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Fixed binary layout of the current lobby, published to shared memory for overlays and HUDs.
+//
+// The writer alternates between two slots, each guarded by a sequence number that is odd while the slot is
+// being written. Readers copy the active slot and retry if its sequence changed underneath them, so any number
+// of readers get a consistent snapshot without locks or syscalls.
+//
+// The reader side builds as the LobbyShm static library, overlays can link it without the rest of the fetcher.
+
+constexpr uint32_t LOBBY_SHM_MAGIC = 0x4C425931; // "LBY1"
+constexpr uint32_t LOBBY_SHM_VERSION = 1;
+constexpr size_t LOBBY_SHM_MAX_PLAYERS = 32;
+constexpr size_t LOBBY_SHM_NAME_LENGTH = 64;
+
+// Attempts Read makes at a consistent copy before giving up, a writer that died mid-publish leaves its slot odd.
+// Retries only spin with a pause hint, so this bounds a failed read to microseconds.
+constexpr int LOBBY_SHM_READ_RETRIES = 1000;
+
+#ifdef _WIN32
+constexpr auto LOBBY_SHM_NAME = "Local\\CS2PlayerFetcherLobby";
+#else
+constexpr auto LOBBY_SHM_NAME = "/cs2_player_fetcher_lobby";
+#endif
+
+enum LobbyShmPlayerFlags : uint32_t
+{
+	LOBBY_SHM_SUCCESS = 1 << 0,
+	LOBBY_SHM_PENDING = 1 << 1,
+	LOBBY_SHM_BANNED = 1 << 2,
+	LOBBY_SHM_SELF = 1 << 3,
+};
+
+struct LobbyShmPlayer
+{
+	uint64_t steamID;
+	int32_t lobbyID;
+	uint32_t flags;
+	int32_t premier;
+	int32_t faceit;
+	int32_t totalMatches;
+	int32_t reserved;
+	float leetify;
+	float aim;
+	float positioning;
+	float utility;
+	float reactionTime;
+	float preaim;
+	float headAccuracy;
+	float winRate;
+	char name[LOBBY_SHM_NAME_LENGTH]; // UTF-8, always null terminated
+};
+
+struct LobbyShmSnapshot
+{
+	uint64_t publishedAtMs; // unix time
+	uint32_t playerCount;
+	uint32_t reserved;
+	LobbyShmPlayer players[LOBBY_SHM_MAX_PLAYERS];
+};
+
+struct LobbyShmSlot
+{
+	std::atomic<uint64_t> sequence;
+	LobbyShmSnapshot snapshot;
+};
+
+struct LobbyShmSegment
+{
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint32_t size;
+	std::atomic<uint32_t> activeSlot;
+	std::atomic<uint64_t> generation; // bumped once per publish
+	LobbyShmSlot slots[2];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "sequence numbers must be lock-free to live in shared memory");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the magic and slot index must be lock-free as well");
+static_assert(sizeof(LobbyShmPlayer) == 128, "LobbyShmPlayer layout is part of the shared memory ABI");
+
+// Copies as much of the name as fits without cutting a UTF-8 sequence in half
+void CopyLobbyShmName(LobbyShmPlayer &player, const std::string &name);
+
+// Maps the segment, shared by the publisher and readers
+class LobbyShmMapping
+{
+  public:
+	LobbyShmMapping() = default;
+	~LobbyShmMapping();
+
+	LobbyShmMapping(const LobbyShmMapping &) = delete;
+	LobbyShmMapping &operator=(const LobbyShmMapping &) = delete;
+
+	bool Map(bool create, const char *name = LOBBY_SHM_NAME);
+	void Unmap();
+
+	LobbyShmSegment *Segment() const
+	{
+		return segment;
+	}
+
+  private:
+	LobbyShmSegment *segment = nullptr;
+	void *osHandle = nullptr;
+	std::string mappedName;
+	bool owner = false;
+};
+
+class LobbyShmPublisher
+{
+  public:
+	bool Open(const char *name = LOBBY_SHM_NAME);
+
+	// Single writer only
+	void Publish(const std::vector<LobbyShmPlayer> &players);
+
+  private:
+	LobbyShmMapping mapping;
+};
+
+class LobbyShmReader
+{
+  public:
+	bool Open(const char *name = LOBBY_SHM_NAME);
+
+	// Copies the latest snapshot, returns false if nothing has been published yet or no consistent copy could be
+	// made within LOBBY_SHM_READ_RETRIES attempts
+	bool Read(LobbyShmSnapshot &out) const;
+
+	// Cheap check for whether Read would return something new
+	uint64_t Generation() const;
+
+  private:
+	LobbyShmMapping mapping;
+};
@@ -1,7 +1,22 @@
 #include "main.h"
 #include "leetify_provider.h"
+#include "lobby_shm.h"
+#include "persona_cache.h"
+#include "session_capture.h"
+#include "stats_store.h"
+#include "teammate_graph.h"
 #include "ui.h"
 #include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <conio.h>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <windows.h>
 
@@ -14,6 +29,23 @@ HSteamUser g_hSteamUser;
 
 bool g_bSteamAPIInitialized = false;
 
+PersonaCache g_PersonaCache;
+constexpr auto PERSONA_CACHE_PATH = "persona_cache.txt";
+
+TeammateGraph g_TeammateGraph;
+constexpr auto TEAMMATE_GRAPH_PATH = "teammate_graph.bin";
+
+LobbyShmPublisher g_LobbyPublisher;
+
+StatsStore g_StatsHistory;
+constexpr auto STATS_HISTORY_PATH = "stats_history.bin";
+
+// Older coplay players refreshed in the background, newest first
+constexpr size_t MAX_BACKGROUND_REFRESH = 20;
+
+// How often the coplay list is checked for a new match while the table is shown
+constexpr DWORD COPLAY_POLL_MS = 5000;
+
 std::string GetSteamClientDllPath()
 {
 	HKEY hKey;
@@ -73,6 +105,196 @@ void CustomSteamAPIShutdown()
 	g_bSteamAPIInitialized = false;
 }
 
+std::vector<CoplayRecord> EnumerateCoplay()
+{
+	std::vector<CoplayRecord> coplay;
+	auto iPlayers = g_pSteamFriends->GetCoplayFriendCount();
+
+	for (int i = 0; i < iPlayers; ++i)
+	{
+		CSteamID playerSteamID = g_pSteamFriends->GetCoplayFriend(i);
+
+		coplay.push_back({playerSteamID, g_pSteamFriends->GetFriendCoplayGame(playerSteamID),
+		                  g_pSteamFriends->GetFriendCoplayTime(playerSteamID)});
+	}
+
+	return coplay;
+}
+
+// Picks the players of the latest match from the coplay list. Older CS2 players end up in older, to be refreshed in
+// the background for the stats history and the teammate graph.
+std::vector<Player> SelectLobby(CSteamID mySteamID, const std::vector<CoplayRecord> &coplay, std::vector<Player> *older)
+{
+	std::vector<Player> players;
+
+	for (const auto &entry : coplay)
+	{
+		if (entry.steamID == mySteamID)
+		{
+			continue;
+		}
+
+		if (entry.app != 730)
+		{
+			continue;
+		}
+
+		players.emplace_back(entry.steamID, entry.time);
+	}
+
+	std::sort(players.begin(), players.end(), [](const Player &a, const Player &b) {
+		if (a.time == b.time)
+		{
+			return a.steamID > b.steamID;
+		}
+
+		return a.time > b.time;
+	});
+
+	int iHighestTimeStamp = 0;
+
+	if (players.size() > 0)
+	{
+		iHighestTimeStamp = players[(std::min)(5, static_cast<int>(players.size()) - 1)].time;
+		iHighestTimeStamp -= 300; // allow slack of 5 minutes because Steam is a bit inconsistent
+	}
+
+	// Sorted newest first, so the lobby is a prefix
+	size_t lobbySize = std::count_if(players.begin(), players.end(), [iHighestTimeStamp](const Player &player) {
+		return iHighestTimeStamp <= player.time;
+	});
+	lobbySize = (std::min)(lobbySize, size_t(9));
+
+	for (auto i = lobbySize; i < players.size() && older->size() < MAX_BACKGROUND_REFRESH; i++)
+	{
+		older->emplace_back(players[i].steamID, players[i].time, FetchPriority::BackgroundRefresh);
+	}
+
+	players.erase(players.begin() + lobbySize, players.end());
+	return players;
+}
+
+static std::vector<CSteamID> SteamIDsOf(const std::vector<Player> &players)
+{
+	std::vector<CSteamID> steamIDs;
+	for (const auto &player : players)
+	{
+		steamIDs.push_back(player.steamID);
+	}
+
+	return steamIDs;
+}
+
+// Returns true once Enter is pressed, false if the timeout passes first
+static bool WaitForEnter(DWORD milliseconds)
+{
+	auto deadline = GetTickCount64() + milliseconds;
+
+	do
+	{
+		while (_kbhit())
+		{
+			if (_getch() == '\r')
+			{
+				return true;
+			}
+		}
+
+		Sleep(50);
+	} while (GetTickCount64() < deadline);
+
+	return false;
+}
+
+void PublishLobby(CSteamID mySteamID, const std::vector<LeetifyUser> &leetifyUsers)
+{
+	std::vector<LobbyShmPlayer> players;
+
+	for (const auto &user : leetifyUsers)
+	{
+		LobbyShmPlayer player{};
+		player.steamID = user.steamID.ConvertToUint64();
+		player.lobbyID = user.lobbyID;
+		player.flags = (user.success ? LOBBY_SHM_SUCCESS : 0) | (user.pending ? LOBBY_SHM_PENDING : 0) |
+		               (!user.bans.empty() ? LOBBY_SHM_BANNED : 0) | (user.steamID == mySteamID ? LOBBY_SHM_SELF : 0);
+		player.premier = user.ranks.premier;
+		player.faceit = user.ranks.faceit;
+		player.totalMatches = user.totalMatches;
+		player.leetify = user.ranks.leetify;
+		player.aim = user.rating.aim;
+		player.positioning = user.rating.positioning;
+		player.utility = user.rating.utility;
+		player.reactionTime = user.skills.reaction_time;
+		player.preaim = user.skills.preaim;
+		player.headAccuracy = user.skills.accuracy_head;
+		player.winRate = user.winRate;
+
+		CopyLobbyShmName(player, GetPersonaName(user));
+
+		players.push_back(player);
+	}
+
+	g_LobbyPublisher.Publish(players);
+}
+
+// Whole-string numeric arguments, anything else is rejected instead of throwing
+static bool ParseArgument(const char *text, int *value)
+{
+	char *end;
+	errno = 0;
+	auto parsed = strtol(text, &end, 10);
+
+	if (end == text || *end != '\0' || errno == ERANGE || parsed < 0 || parsed > INT_MAX)
+	{
+		return false;
+	}
+
+	*value = static_cast<int>(parsed);
+	return true;
+}
+
+static bool ParseArgument(const char *text, double *value)
+{
+	char *end;
+	errno = 0;
+	auto parsed = strtod(text, &end);
+
+	if (end == text || *end != '\0' || errno == ERANGE || !(parsed > 0.0) || !std::isfinite(parsed))
+	{
+		return false;
+	}
+
+	*value = parsed;
+	return true;
+}
+
+static void PrintUsage()
+{
+	printf("Usage: PlayerFetch [options]\n");
+	printf("  -demo                    show a fixed list of players\n");
+	printf("  -deadline <ms>           render partial results after this long, 0 waits for all (default 3000)\n");
+	printf("  -record <dir>            save coplay, persona names and every transfer to <dir>\n");
+	printf("  -replay <dir>            run a recorded session without Steam or the network\n");
+	printf("  -replay-speed <x>        scale recorded latencies down by <x> (default 1)\n");
+	printf("  -batch-endpoint <url>    fetch profiles in batches from an aggregation proxy\n");
+	printf("\n");
+	printf("Replayed transfers go through the same scheduler as live ones: the concurrency cap, preemption,\n");
+	printf("hedging and batching all run, and each transfer lands after its recorded latency. Connection setup,\n");
+	printf("bandwidth and cURL itself are not simulated.\n");
+}
+
+// The table and status lines are redrawn with escape sequences, which conhost only interprets once asked to
+static void EnableVirtualTerminal()
+{
+	auto output = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD mode = 0;
+
+	if (GetConsoleMode(output, &mode))
+	{
+		SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+	}
+}
+
 BOOL WINAPI consoleHandler(DWORD signal)
 {
 	if (signal == CTRL_CLOSE_EVENT || signal == CTRL_C_EVENT || signal == CTRL_BREAK_EVENT)
@@ -86,10 +308,16 @@ BOOL WINAPI consoleHandler(DWORD signal)
 int main(int argc, char* argv[])
 {
 	SetConsoleOutputCP(65001);
+	EnableVirtualTerminal();
 	SetConsoleCtrlHandler(consoleHandler, true);
 	SetConsoleTitle("Leetify Stats");
 
 	auto demoMode = false;
+	auto deadlineMs = 3000;
+	auto replaySpeed = 1.0;
+	std::string recordDirectory;
+	std::string replayDirectory;
+	std::string batchEndpoint;
 
 	for (int i = 1; i < argc; i++) 
 	{
@@ -97,61 +325,78 @@ int main(int argc, char* argv[])
 		{
 			demoMode = true;
 		}
-	}
-
-	CustomSteamAPIInit();
-
-	auto mySteamID = g_pSteamUser->GetSteamID();
-	auto iPlayers = g_pSteamFriends->GetCoplayFriendCount();
-
-	std::vector<Player> players;
-
-	for (int i = 0; i < iPlayers; ++i)
-	{
-		CSteamID playerSteamID = g_pSteamFriends->GetCoplayFriend(i);
-
-		if (playerSteamID == mySteamID)
+		else if (strcmp(argv[i], "-deadline") == 0 && i + 1 < argc)
 		{
-			continue;
+			if (!ParseArgument(argv[++i], &deadlineMs))
+			{
+				printf("Invalid -deadline %s, expected milliseconds\n", argv[i]);
+				return 1;
+			}
 		}
-
-		AppId_t app = g_pSteamFriends->GetFriendCoplayGame(playerSteamID);
-
-		if (app != 730)
+		else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
 		{
-			continue;
+			recordDirectory = argv[++i];
 		}
-
-		int iTimeStamp = g_pSteamFriends->GetFriendCoplayTime(playerSteamID);
-
-		players.emplace_back(playerSteamID, iTimeStamp);
-	}
-
-	std::sort(players.begin(), players.end(), [](const Player &a, const Player &b) {
-		if (a.time == b.time)
+		else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
 		{
-			return a.steamID > b.steamID;
+			replayDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "-replay-speed") == 0 && i + 1 < argc)
+		{
+			if (!ParseArgument(argv[++i], &replaySpeed))
+			{
+				printf("Invalid -replay-speed %s, expected a positive number\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-batch-endpoint") == 0 && i + 1 < argc)
+		{
+			batchEndpoint = argv[++i];
+		}
+		else if (strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0)
+		{
+			PrintUsage();
+			return 0;
 		}
+	}
 
-		return a.time > b.time;
-	});
+	// Replaying needs neither the Steam client nor the network
+	SessionCapture capture;
+	auto recording = !recordDirectory.empty();
+	auto replaying = !replayDirectory.empty();
+
+	if (replaying && !capture.Load(replayDirectory))
+	{
+		printf("Failed to load recording from %s\n", replayDirectory.c_str());
+		return 1;
+	}
 
-	int iHighestTimeStamp;
+	CSteamID mySteamID;
+	std::vector<CoplayRecord> coplay;
 
-	if (players.size() > 0)
+	if (replaying)
 	{
-		iHighestTimeStamp = players[(std::min)(5, static_cast<int>(players.size()) - 1)].time;
-		iHighestTimeStamp -= 300; // allow slack of 5 minutes because Steam is a bit inconsistent
+		mySteamID = capture.MySteamID();
+		coplay = capture.Coplay().front().coplay;
 	}
+	else
+	{
+		CustomSteamAPIInit();
 
-	std::erase_if(players, [iHighestTimeStamp](const Player &player) { return iHighestTimeStamp > player.time; });
+		mySteamID = g_pSteamUser->GetSteamID();
+		coplay = EnumerateCoplay();
+	}
 
-	if (players.size() > 9)
+	if (recording)
 	{
-		players.erase(players.begin() + 9, players.end());
+		capture.SetMySteamID(mySteamID);
+		capture.AddCoplay(std::chrono::milliseconds(0), coplay);
 	}
 
-	players.emplace_back(mySteamID, 0);
+	std::vector<Player> older;
+	auto players = SelectLobby(mySteamID, coplay, &older);
+
+	players.emplace_back(mySteamID, 0, FetchPriority::Self);
 
 	if (demoMode)
 	{
@@ -168,24 +413,304 @@ int main(int argc, char* argv[])
 		players.emplace_back(CSteamID(76561197991272318ul), now);
 		players.emplace_back(CSteamID(76561197989744167ul), now);
 		players.emplace_back(CSteamID(76561198113666193ul), now);
+		older.clear();
+	}
+
+	// Resolved by Steam while the profiles are being fetched
+	auto steamIDs = SteamIDsOf(players);
+
+	if (replaying)
+	{
+		for (const auto &[steamID, name] : capture.PersonaNames())
+		{
+			g_PersonaCache.Set(CSteamID(steamID), name);
+		}
+	}
+	else
+	{
+		g_PersonaCache.SetFriends(g_pSteamFriends);
+		g_PersonaCache.Load(PERSONA_CACHE_PATH);
+		g_PersonaCache.Request(steamIDs);
+
+		g_TeammateGraph.Load(TEAMMATE_GRAPH_PATH);
+		g_StatsHistory.Load(STATS_HISTORY_PATH);
 	}
 
-	auto leetifyUsers = GetLeetifyUsers(players);
+	if (!g_LobbyPublisher.Open())
+	{
+		printf("Failed to open shared memory for lobby publishing\n");
+	}
+
+	// Everything below is shared with the fetch's callbacks and guarded by usersMutex
+	std::mutex usersMutex;
+	std::vector<LeetifyUser> leetifyUsers;
+	std::vector<Player> lobby = players;
+	std::unordered_set<uint64> lobbySteamIDs;
+	std::unordered_map<uint64, std::vector<CSteamID>> expansions;
+
+	for (const auto &player : lobby)
+	{
+		lobbySteamIDs.insert(player.steamID.ConvertToUint64());
+	}
 
-	Render(mySteamID, leetifyUsers);
+	// Stopped before main's locals go away, its callbacks reference them
+	std::unique_ptr<LeetifyFetch> fetch;
 
-	CustomSteamAPIShutdown();
+	// Strong teammates of a lobby player are fetched at a lower priority, so the teammate graph can link premades
+	// through players who aren't in the lobby themselves
+	auto expandTeammates = [&](const LeetifyUser &user) {
+		if (!user.success || expansions.contains(user.steamID.ConvertToUint64()))
+		{
+			return;
+		}
 
-	(void)(getchar());
+		auto &expanded = expansions[user.steamID.ConvertToUint64()];
+		std::vector<Player> teammates;
+
+		for (const auto &teammate : user.recentTeammates)
+		{
+			if (teammate.matchCount >= TeammateGraph::MIN_PREMADE_MATCHES &&
+			    !lobbySteamIDs.contains(teammate.steamID.ConvertToUint64()))
+			{
+				teammates.emplace_back(teammate.steamID, 0, FetchPriority::TeammateExpansion);
+				expanded.push_back(teammate.steamID);
+			}
+		}
+
+		if (!teammates.empty())
+		{
+			fetch->Submit(teammates);
+		}
+	};
+
+	FetchOptions fetchOptions;
+	fetchOptions.deadline = std::chrono::milliseconds(deadlineMs);
+	fetchOptions.batchEndpoint = batchEndpoint;
+	fetchOptions.onLog = PrintStatus;
+	fetchOptions.onResult = [&](const LeetifyUser &user) {
+		std::lock_guard lock(usersMutex);
+
+		// Background and expansion results only feed the history and the graph
+		g_TeammateGraph.AddProfile(user);
+
+		if (user.success)
+		{
+			g_StatsHistory.Upsert(user);
+		}
+
+		if (lobbySteamIDs.contains(user.steamID.ConvertToUint64()))
+		{
+			expandTeammates(user);
+		}
+
+		auto it = std::find_if(leetifyUsers.begin(), leetifyUsers.end(),
+		                       [&user](const LeetifyUser &u) { return u.steamID == user.steamID; });
+
+		// Before the first render the table is filled from the fetch instead
+		if (it != leetifyUsers.end())
+		{
+			*it = user;
+			g_PersonaCache.Refresh();
+			Render(mySteamID, leetifyUsers, g_TeammateGraph, g_StatsHistory);
+			PublishLobby(mySteamID, leetifyUsers);
+		}
+	};
+
+	if (recording)
+	{
+		fetchOptions.onTransfer = [&capture](const TransferRecord &transfer) { capture.AddTransfer(transfer); };
+	}
+
+	if (replaying)
+	{
+		fetchOptions.replay = &capture.Transfers();
+		fetchOptions.replaySpeed = replaySpeed;
+	}
+
+	fetch = std::make_unique<LeetifyFetch>(fetchOptions);
+	fetch->Submit(players);
+	fetch->Submit(older);
+	fetch->Wait(steamIDs);
+
+	{
+		// Results that landed since Wait returned are part of this snapshot, later ones wait for the lock
+		std::lock_guard lock(usersMutex);
+
+		leetifyUsers = fetch->Users(steamIDs);
+
+		if (!replaying)
+		{
+			g_TeammateGraph.Flush(TEAMMATE_GRAPH_PATH);
+		}
+
+		g_PersonaCache.Refresh();
+		Render(mySteamID, leetifyUsers, g_TeammateGraph, g_StatsHistory);
+		PublishLobby(mySteamID, leetifyUsers);
+	}
+
+	// A new match in the coplay list replaces the lobby shown
+	auto followCoplay = [&](const std::vector<CoplayRecord> &nextCoplay) {
+		std::vector<Player> nextOlder;
+		auto nextLobby = SelectLobby(mySteamID, nextCoplay, &nextOlder);
+		nextLobby.emplace_back(mySteamID, 0, FetchPriority::Self);
+
+		std::unordered_set<uint64> nextSteamIDs;
+		for (const auto &player : nextLobby)
+		{
+			nextSteamIDs.insert(player.steamID.ConvertToUint64());
+		}
+
+		std::lock_guard lock(usersMutex);
+
+		if (nextSteamIDs == lobbySteamIDs)
+		{
+			return;
+		}
+
+		// Players who left the lobby, and teammates fetched only because of them, are no longer needed
+		std::vector<CSteamID> departed;
+		for (const auto &player : lobby)
+		{
+			auto steamID = player.steamID.ConvertToUint64();
+			if (nextSteamIDs.contains(steamID))
+			{
+				continue;
+			}
+
+			departed.push_back(player.steamID);
+
+			auto expanded = expansions.find(steamID);
+			if (expanded != expansions.end())
+			{
+				departed.insert(departed.end(), expanded->second.begin(), expanded->second.end());
+				expansions.erase(expanded);
+			}
+		}
+
+		// Unless they are still in the coplay list or another lobby player's teammate, then they keep being
+		// fetched, in the background if they left the lobby
+		std::unordered_set<uint64> stillWanted = nextSteamIDs;
+		for (const auto &player : nextOlder)
+		{
+			stillWanted.insert(player.steamID.ConvertToUint64());
+		}
+
+		for (const auto &[steamID, teammates] : expansions)
+		{
+			for (auto teammate : teammates)
+			{
+				stillWanted.insert(teammate.ConvertToUint64());
+			}
+		}
+
+		std::vector<CSteamID> superseded;
+		for (auto steamID : departed)
+		{
+			if (!stillWanted.contains(steamID.ConvertToUint64()))
+			{
+				superseded.push_back(steamID);
+			}
+		}
+
+		fetch->Cancel(superseded);
+
+		lobby = nextLobby;
+		lobbySteamIDs = nextSteamIDs;
+		steamIDs = SteamIDsOf(lobby);
+
+		// Players fetched before keep their results, queued ones move up to the lobby's priority
+		fetch->Submit(lobby);
+		fetch->Submit(nextOlder);
+		g_PersonaCache.Request(steamIDs);
+
+		leetifyUsers = fetch->Users(steamIDs);
+		for (const auto &user : leetifyUsers)
+		{
+			expandTeammates(user);
+		}
+
+		if (!replaying)
+		{
+			g_TeammateGraph.Flush(TEAMMATE_GRAPH_PATH);
+		}
+
+		g_PersonaCache.Refresh();
+		Render(mySteamID, leetifyUsers, g_TeammateGraph, g_StatsHistory);
+		PublishLobby(mySteamID, leetifyUsers);
+	};
+
+	if (demoMode)
+	{
+		(void)(getchar());
+	}
+	else if (replaying)
+	{
+		// Later enumerations land at their recorded offsets, scaled like the transfers, until Enter is pressed
+		auto stopped = false;
+		const auto &snapshots = capture.Coplay();
+
+		for (size_t i = 1; i < snapshots.size() && !stopped; i++)
+		{
+			auto due = std::chrono::duration_cast<std::chrono::milliseconds>(snapshots[i].offset / replaySpeed);
+			auto wait = due - fetch->Elapsed();
+
+			stopped = wait.count() > 0 && WaitForEnter(static_cast<DWORD>(wait.count()));
+			if (!stopped)
+			{
+				followCoplay(snapshots[i].coplay);
+			}
+		}
+
+		if (!stopped)
+		{
+			(void)(getchar());
+		}
+	}
+	else
+	{
+		// Follows the coplay list until Enter is pressed
+		while (!WaitForEnter(COPLAY_POLL_MS))
+		{
+			auto nextCoplay = EnumerateCoplay();
+			if (recording)
+			{
+				capture.AddCoplay(fetch->Elapsed(), nextCoplay);
+			}
+
+			followCoplay(nextCoplay);
+		}
+	}
+
+	fetch->Stop();
+
+	{
+		std::lock_guard lock(usersMutex);
+		g_PersonaCache.Refresh();
+
+		if (recording)
+		{
+			capture.SetPersonaNames(g_PersonaCache.Names());
+			capture.Save(recordDirectory);
+		}
+
+		if (!replaying)
+		{
+			g_PersonaCache.Save(PERSONA_CACHE_PATH);
+			g_TeammateGraph.Flush(TEAMMATE_GRAPH_PATH);
+			g_StatsHistory.Save(STATS_HISTORY_PATH);
+		}
+
+		CustomSteamAPIShutdown();
+	}
 
 	return 0;
 }
 
 std::string GetPersonaName(LeetifyUser user)
 {
-	auto playerName = std::string(g_pSteamFriends->GetFriendPersonaName(user.steamID));
+	auto playerName = g_PersonaCache.Lookup(user.steamID);
 
-	if (playerName.empty() || playerName == "[unknown]")
+	if (playerName.empty())
 	{
 		playerName = user.name;
 	}
@@ -0,0 +1,98 @@
+#include "persona_cache.h"
+#include <algorithm>
+#include <fstream>
+
+bool PersonaCache::Load(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	// One "<steam64> <name>" entry per line
+	uint64 steamID;
+	std::string name;
+	while (file >> steamID && file.get() == ' ' && std::getline(file, name))
+	{
+		if (!name.empty())
+		{
+			names[steamID] = name;
+		}
+	}
+
+	return true;
+}
+
+bool PersonaCache::Save(const std::string &path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	for (const auto &[steamID, name] : names)
+	{
+		file << steamID << ' ' << name << '\n';
+	}
+
+	return static_cast<bool>(file);
+}
+
+void PersonaCache::Request(const std::vector<CSteamID> &steamIDs)
+{
+	if (!friends)
+	{
+		return;
+	}
+
+	for (auto steamID : steamIDs)
+	{
+		// Returns false when Steam already has the name, otherwise it is fetched in the background
+		if (friends->RequestUserInformation(steamID, true) || !TryResolve(steamID))
+		{
+			if (std::find(unresolved.begin(), unresolved.end(), steamID) == unresolved.end())
+			{
+				unresolved.push_back(steamID);
+			}
+		}
+	}
+}
+
+void PersonaCache::Refresh()
+{
+	if (!friends)
+	{
+		return;
+	}
+
+	std::erase_if(unresolved, [this](CSteamID steamID) { return TryResolve(steamID); });
+}
+
+void PersonaCache::Set(CSteamID steamID, const std::string &name)
+{
+	if (!name.empty() && name != "[unknown]")
+	{
+		names[steamID.ConvertToUint64()] = name;
+	}
+}
+
+std::string PersonaCache::Lookup(CSteamID steamID) const
+{
+	auto it = names.find(steamID.ConvertToUint64());
+	return it != names.end() ? it->second : std::string();
+}
+
+bool PersonaCache::TryResolve(CSteamID steamID)
+{
+	auto name = friends->GetFriendPersonaName(steamID);
+
+	if (!name || !*name || std::string(name) == "[unknown]")
+	{
+		return false;
+	}
+
+	Set(steamID, name);
+	return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "steam_api.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Persona names resolved ahead of rendering, so drawing a table never has to go through Steam IPC
+class PersonaCache
+{
+  public:
+	explicit PersonaCache(ISteamFriends *steamFriends = nullptr) : friends(steamFriends)
+	{
+	}
+
+	void SetFriends(ISteamFriends *steamFriends)
+	{
+		friends = steamFriends;
+	}
+
+	bool Load(const std::string &path);
+	bool Save(const std::string &path) const;
+
+	// Asks Steam for every name in one go, the ones it already knows are stored straight away
+	void Request(const std::vector<CSteamID> &steamIDs);
+
+	// Stores names that arrived since Request, call before redrawing
+	void Refresh();
+
+	void Set(CSteamID steamID, const std::string &name);
+
+	// Empty when the name is not known yet
+	std::string Lookup(CSteamID steamID) const;
+
+	const std::unordered_map<uint64, std::string> &Names() const
+	{
+		return names;
+	}
+
+  private:
+	bool TryResolve(CSteamID steamID);
+
+	ISteamFriends *friends;
+	std::unordered_map<uint64, std::string> names;
+	std::vector<CSteamID> unresolved;
+};
@@ -0,0 +1,173 @@
+#include "session_capture.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+static bool ReadJson(const std::filesystem::path &path, nlohmann::json &json)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		printf("Failed to open %s\n", path.string().c_str());
+		return false;
+	}
+
+	try
+	{
+		json = nlohmann::json::parse(file);
+		return true;
+	}
+	catch (const std::exception &e)
+	{
+		printf("Failed to parse %s: %s\n", path.string().c_str(), e.what());
+		return false;
+	}
+}
+
+static bool WriteJson(const std::filesystem::path &path, const nlohmann::json &json)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		printf("Failed to write %s\n", path.string().c_str());
+		return false;
+	}
+
+	// Response bodies are not guaranteed to be valid UTF-8
+	file << json.dump(1, '\t', false, nlohmann::json::error_handler_t::replace);
+	return static_cast<bool>(file);
+}
+
+bool SessionCapture::Load(const std::string &directory)
+{
+	std::filesystem::path root(directory);
+	nlohmann::json coplayJson, transfersJson, personasJson;
+
+	if (!ReadJson(root / "coplay.json", coplayJson) || !ReadJson(root / "transfers.json", transfersJson) ||
+	    !ReadJson(root / "personas.json", personasJson))
+	{
+		return false;
+	}
+
+	std::lock_guard lock(mutex);
+
+	try
+	{
+		mySteamID = CSteamID(coplayJson.at("self").get<uint64>());
+
+		for (const auto &enumeration : coplayJson.at("enumerations"))
+		{
+			auto &snapshot = coplay.emplace_back();
+			snapshot.offset = std::chrono::milliseconds(enumeration.at("offset_ms").get<long long>());
+
+			for (const auto &entry : enumeration.at("friends"))
+			{
+				snapshot.coplay.push_back({CSteamID(entry.at("steam64_id").get<uint64>()),
+				                           entry.at("app").get<AppId_t>(), entry.at("time").get<int>()});
+			}
+		}
+
+		if (coplay.empty())
+		{
+			printf("Failed to load capture from %s: no coplay list\n", directory.c_str());
+			return false;
+		}
+
+		std::stable_sort(coplay.begin(), coplay.end(),
+		                 [](const CoplaySnapshot &a, const CoplaySnapshot &b) { return a.offset < b.offset; });
+
+		for (const auto &entry : transfersJson)
+		{
+			transfers.push_back({CSteamID(entry.at("steam64_id").get<uint64>()), entry.at("curl_result").get<int>(),
+			                     entry.at("response_code").get<long>(), entry.at("headers").get<std::string>(),
+			                     entry.at("body").get<std::string>(),
+			                     std::chrono::milliseconds(entry.at("start_ms").get<long long>()),
+			                     std::chrono::milliseconds(entry.at("elapsed_ms").get<long long>())});
+		}
+
+		for (const auto &[steamID, name] : personasJson.items())
+		{
+			personaNames[std::stoull(steamID)] = name.get<std::string>();
+		}
+	}
+	catch (const std::exception &e)
+	{
+		printf("Failed to load capture from %s: %s\n", directory.c_str(), e.what());
+		return false;
+	}
+
+	return true;
+}
+
+bool SessionCapture::Save(const std::string &directory) const
+{
+	std::error_code error;
+	std::filesystem::path root(directory);
+	std::filesystem::create_directories(root, error);
+
+	std::lock_guard lock(mutex);
+
+	nlohmann::json coplayJson = {{"self", mySteamID.ConvertToUint64()}, {"enumerations", nlohmann::json::array()}};
+	for (const auto &snapshot : coplay)
+	{
+		auto friends = nlohmann::json::array();
+		for (const auto &entry : snapshot.coplay)
+		{
+			friends.push_back(
+			    {{"steam64_id", entry.steamID.ConvertToUint64()}, {"app", entry.app}, {"time", entry.time}});
+		}
+
+		coplayJson["enumerations"].push_back({{"offset_ms", snapshot.offset.count()}, {"friends", friends}});
+	}
+
+	auto transfersJson = nlohmann::json::array();
+	for (const auto &transfer : transfers)
+	{
+		transfersJson.push_back({{"steam64_id", transfer.steamID.ConvertToUint64()},
+		                         {"curl_result", transfer.curlResult},
+		                         {"response_code", transfer.responseCode},
+		                         {"headers", transfer.headers},
+		                         {"body", transfer.body},
+		                         {"start_ms", transfer.startOffset.count()},
+		                         {"elapsed_ms", transfer.elapsed.count()}});
+	}
+
+	auto personasJson = nlohmann::json::object();
+	for (const auto &[steamID, name] : personaNames)
+	{
+		personasJson[std::to_string(steamID)] = name;
+	}
+
+	return WriteJson(root / "coplay.json", coplayJson) && WriteJson(root / "transfers.json", transfersJson) &&
+	       WriteJson(root / "personas.json", personasJson);
+}
+
+void SessionCapture::SetMySteamID(CSteamID steamID)
+{
+	std::lock_guard lock(mutex);
+	mySteamID = steamID;
+}
+
+void SessionCapture::AddCoplay(std::chrono::milliseconds offset, const std::vector<CoplayRecord> &records)
+{
+	std::lock_guard lock(mutex);
+
+	// Polling mostly sees the same list again, replaying it would change nothing
+	if (coplay.empty() || coplay.back().coplay != records)
+	{
+		coplay.push_back({offset, records});
+	}
+}
+
+void SessionCapture::SetPersonaNames(const std::unordered_map<uint64, std::string> &names)
+{
+	std::lock_guard lock(mutex);
+	personaNames = names;
+}
+
+void SessionCapture::AddTransfer(const TransferRecord &transfer)
+{
+	std::lock_guard lock(mutex);
+	transfers.push_back(transfer);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "leetify_provider.h"
+#include "steam_api.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CoplayRecord
+{
+	CSteamID steamID;
+	AppId_t app;
+	int time;
+
+	bool operator==(const CoplayRecord &) const = default;
+};
+
+// The coplay list as enumerated at some point of the session
+struct CoplaySnapshot
+{
+	std::chrono::milliseconds offset; // since the fetch began
+	std::vector<CoplayRecord> coplay;
+};
+
+// Everything a run depends on from Steam and the network, so a session can be recorded with -record and played
+// back deterministically with -replay
+class SessionCapture
+{
+  public:
+	bool Load(const std::string &directory);
+	bool Save(const std::string &directory) const;
+
+	void SetMySteamID(CSteamID mySteamID);
+
+	// Records one enumeration of the coplay list, unless it is the same as the last one
+	void AddCoplay(std::chrono::milliseconds offset, const std::vector<CoplayRecord> &coplay);
+	void SetPersonaNames(const std::unordered_map<uint64, std::string> &names);
+
+	// Safe to call from the network thread
+	void AddTransfer(const TransferRecord &transfer);
+
+	CSteamID MySteamID() const
+	{
+		return mySteamID;
+	}
+
+	// Not synchronized, only for replaying a loaded capture. Ordered by offset, the first one is the coplay list the
+	// session started from.
+	const std::vector<CoplaySnapshot> &Coplay() const
+	{
+		return coplay;
+	}
+
+	const std::vector<TransferRecord> &Transfers() const
+	{
+		return transfers;
+	}
+
+	const std::unordered_map<uint64, std::string> &PersonaNames() const
+	{
+		return personaNames;
+	}
+
+  private:
+	mutable std::mutex mutex;
+	CSteamID mySteamID;
+	std::vector<CoplaySnapshot> coplay;
+	std::vector<TransferRecord> transfers;
+	std::unordered_map<uint64, std::string> personaNames;
+};
@@ -0,0 +1,393 @@
+#include "stats_store.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define STATS_STORE_SSE2
+#endif
+
+constexpr uint32_t STATS_STORE_MAGIC = 0x32535453; // "STS2"
+
+// Also stored every row's group, and missing stats as 0
+constexpr uint32_t STATS_STORE_MAGIC_V1 = 0x31535453; // "STS1"
+
+float GetStat(const LeetifyUser &user, Stat stat)
+{
+	switch (stat)
+	{
+	case Stat::LeetifyRank:
+		return user.ranks.leetify;
+	case Stat::Premier:
+		return static_cast<float>(user.ranks.premier);
+	case Stat::Faceit:
+		return static_cast<float>(user.ranks.faceit);
+	case Stat::Aim:
+		return user.rating.aim;
+	case Stat::Positioning:
+		return user.rating.positioning;
+	case Stat::Utility:
+		return user.rating.utility;
+	case Stat::Clutch:
+		return user.rating.clutch;
+	case Stat::Opening:
+		return user.rating.opening;
+	case Stat::CtLeetify:
+		return user.rating.ct_leetify;
+	case Stat::TLeetify:
+		return user.rating.t_leetify;
+	case Stat::AccuracyEnemySpotted:
+		return user.skills.accuracy_enemy_spotted;
+	case Stat::AccuracyHead:
+		return user.skills.accuracy_head;
+	case Stat::CounterStrafingGoodShotsRatio:
+		return user.skills.counter_strafing_good_shots_ratio;
+	case Stat::CtOpeningAggressionSuccessRate:
+		return user.skills.ct_opening_aggression_success_rate;
+	case Stat::CtOpeningDuelSuccessPercentage:
+		return user.skills.ct_opening_duel_success_percentage;
+	case Stat::FlashbangHitFoeAvgDuration:
+		return user.skills.flashbang_hit_foe_avg_duration;
+	case Stat::FlashbangHitFoePerFlashbang:
+		return user.skills.flashbang_hit_foe_per_flashbang;
+	case Stat::FlashbangHitFriendPerFlashbang:
+		return user.skills.flashbang_hit_friend_per_flashbang;
+	case Stat::FlashbangLeadingToKill:
+		return user.skills.flashbang_leading_to_kill;
+	case Stat::FlashbangThrown:
+		return user.skills.flashbang_thrown;
+	case Stat::HeFoesDamageAvg:
+		return user.skills.he_foes_damage_avg;
+	case Stat::HeFriendsDamageAvg:
+		return user.skills.he_friends_damage_avg;
+	case Stat::Preaim:
+		return user.skills.preaim;
+	case Stat::ReactionTime:
+		return user.skills.reaction_time;
+	case Stat::SprayAccuracy:
+		return user.skills.spray_accuracy;
+	case Stat::TOpeningAggressionSuccessRate:
+		return user.skills.t_opening_aggression_success_rate;
+	case Stat::TOpeningDuelSuccessPercentage:
+		return user.skills.t_opening_duel_success_percentage;
+	case Stat::TradedDeathsSuccessPercentage:
+		return user.skills.traded_deaths_success_percentage;
+	case Stat::TradeKillOpportunitiesPerRound:
+		return user.skills.trade_kill_opportunities_per_round;
+	case Stat::TradeKillsSuccessPercentage:
+		return user.skills.trade_kills_success_percentage;
+	case Stat::UtilityOnDeathAvg:
+		return user.skills.utility_on_death_avg;
+	case Stat::WinRate:
+		return user.winRate;
+	case Stat::TotalMatches:
+		return static_cast<float>(user.totalMatches);
+	default:
+		return 0.0f;
+	}
+}
+
+static bool ZeroIsMissing(Stat stat)
+{
+	switch (stat)
+	{
+	// Centred on 0, or 0 is simply the best outcome
+	case Stat::LeetifyRank:
+	case Stat::Clutch:
+	case Stat::Opening:
+	case Stat::CtLeetify:
+	case Stat::TLeetify:
+	case Stat::FlashbangHitFriendPerFlashbang:
+	case Stat::HeFriendsDamageAvg:
+	case Stat::TotalMatches:
+		return false;
+	default:
+		return true;
+	}
+}
+
+float GetStatOrNaN(const LeetifyUser &user, Stat stat)
+{
+	auto value = GetStat(user, stat);
+	return value == 0.0f && ZeroIsMissing(stat) ? NAN : value;
+}
+
+#ifdef STATS_STORE_SSE2
+static size_t SumLanes(__m128i lanes)
+{
+	alignas(16) int32_t counts[4];
+	_mm_store_si128(reinterpret_cast<__m128i *>(counts), lanes);
+	return static_cast<size_t>(counts[0]) + counts[1] + counts[2] + counts[3];
+}
+#endif
+
+// Sums in double precision so columns with millions of rows don't drift. NaNs are skipped, present counts the rest.
+static double SumColumn(const float *values, size_t count, size_t &present)
+{
+	size_t i = 0;
+	double sum = 0.0;
+	present = 0;
+
+#ifdef STATS_STORE_SSE2
+	auto low = _mm_setzero_pd();
+	auto high = _mm_setzero_pd();
+	auto hits = _mm_setzero_si128();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		// Ordered compares are false only for NaN lanes
+		auto chunk = _mm_loadu_ps(values + i);
+		auto mask = _mm_cmpord_ps(chunk, chunk);
+		chunk = _mm_and_ps(chunk, mask);
+
+		low = _mm_add_pd(low, _mm_cvtps_pd(chunk));
+		high = _mm_add_pd(high, _mm_cvtps_pd(_mm_movehl_ps(chunk, chunk)));
+		hits = _mm_sub_epi32(hits, _mm_castps_si128(mask));
+	}
+
+	alignas(16) double lanes[2];
+	_mm_store_pd(lanes, _mm_add_pd(low, high));
+	sum = lanes[0] + lanes[1];
+	present = SumLanes(hits);
+#endif
+
+	for (; i < count; i++)
+	{
+		if (!std::isnan(values[i]))
+		{
+			sum += values[i];
+			present++;
+		}
+	}
+
+	return sum;
+}
+
+// Sums the values whose group matches, also counting how many did. NaNs neither count nor match.
+static double SumGroup(const float *values, const int32_t *groups, size_t count, int32_t group, size_t &matched)
+{
+	size_t i = 0;
+	double sum = 0.0;
+	matched = 0;
+
+#ifdef STATS_STORE_SSE2
+	auto target = _mm_set1_epi32(group);
+	auto low = _mm_setzero_pd();
+	auto high = _mm_setzero_pd();
+	auto hits = _mm_setzero_si128();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		auto chunk = _mm_loadu_ps(values + i);
+		auto inGroup = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(groups + i)), target);
+		auto mask = _mm_and_si128(inGroup, _mm_castps_si128(_mm_cmpord_ps(chunk, chunk)));
+		chunk = _mm_and_ps(chunk, _mm_castsi128_ps(mask));
+
+		low = _mm_add_pd(low, _mm_cvtps_pd(chunk));
+		high = _mm_add_pd(high, _mm_cvtps_pd(_mm_movehl_ps(chunk, chunk)));
+
+		// Matching lanes are all ones, i.e. -1
+		hits = _mm_sub_epi32(hits, mask);
+	}
+
+	alignas(16) double sumLanes[2];
+	_mm_store_pd(sumLanes, _mm_add_pd(low, high));
+	sum = sumLanes[0] + sumLanes[1];
+
+	matched = SumLanes(hits);
+#endif
+
+	for (; i < count; i++)
+	{
+		if (groups[i] == group && !std::isnan(values[i]))
+		{
+			sum += values[i];
+			matched++;
+		}
+	}
+
+	return sum;
+}
+
+// NaN compares false, so missing values are never below, present counts the values that aren't missing
+static size_t CountBelow(const float *values, size_t count, float threshold, size_t &present)
+{
+	size_t i = 0;
+	size_t below = 0;
+	present = 0;
+
+#ifdef STATS_STORE_SSE2
+	auto limit = _mm_set1_ps(threshold);
+	auto hits = _mm_setzero_si128();
+	auto valid = _mm_setzero_si128();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		auto chunk = _mm_loadu_ps(values + i);
+		hits = _mm_sub_epi32(hits, _mm_castps_si128(_mm_cmplt_ps(chunk, limit)));
+		valid = _mm_sub_epi32(valid, _mm_castps_si128(_mm_cmpord_ps(chunk, chunk)));
+	}
+
+	below = SumLanes(hits);
+	present = SumLanes(valid);
+#endif
+
+	for (; i < count; i++)
+	{
+		below += values[i] < threshold;
+		present += !std::isnan(values[i]);
+	}
+
+	return below;
+}
+
+bool StatsStore::Load(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	uint32_t magic = 0;
+	uint32_t statCount = 0;
+	uint64 rowCount = 0;
+	file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char *>(&statCount), sizeof(statCount));
+	file.read(reinterpret_cast<char *>(&rowCount), sizeof(rowCount));
+
+	// Written by a build with a different set of stats, start over rather than misread it
+	if (!file || (magic != STATS_STORE_MAGIC && magic != STATS_STORE_MAGIC_V1) || statCount != STAT_COUNT)
+	{
+		return false;
+	}
+
+	std::vector<uint64> loadedSteamIDs(rowCount);
+	std::array<std::vector<float>, STAT_COUNT> loadedColumns;
+
+	file.read(reinterpret_cast<char *>(loadedSteamIDs.data()), rowCount * sizeof(uint64));
+
+	if (magic == STATS_STORE_MAGIC_V1)
+	{
+		file.seekg(rowCount * sizeof(int32_t), std::ios::cur);
+	}
+
+	for (auto &column : loadedColumns)
+	{
+		column.resize(rowCount);
+		file.read(reinterpret_cast<char *>(column.data()), rowCount * sizeof(float));
+	}
+
+	if (!file)
+	{
+		return false;
+	}
+
+	if (magic == STATS_STORE_MAGIC_V1)
+	{
+		for (size_t i = 0; i < STAT_COUNT; i++)
+		{
+			if (ZeroIsMissing(static_cast<Stat>(i)))
+			{
+				std::replace(loadedColumns[i].begin(), loadedColumns[i].end(), 0.0f, NAN);
+			}
+		}
+	}
+
+	rows.clear();
+	for (size_t i = 0; i < loadedSteamIDs.size(); i++)
+	{
+		rows[loadedSteamIDs[i]] = i;
+	}
+
+	steamIDs = std::move(loadedSteamIDs);
+	groups.assign(steamIDs.size(), 0);
+	columns = std::move(loadedColumns);
+	return true;
+}
+
+bool StatsStore::Save(const std::string &path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	auto magic = STATS_STORE_MAGIC;
+	auto statCount = static_cast<uint32_t>(STAT_COUNT);
+	auto rowCount = static_cast<uint64>(steamIDs.size());
+	file.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+	file.write(reinterpret_cast<const char *>(&statCount), sizeof(statCount));
+	file.write(reinterpret_cast<const char *>(&rowCount), sizeof(rowCount));
+	file.write(reinterpret_cast<const char *>(steamIDs.data()), rowCount * sizeof(uint64));
+
+	for (const auto &column : columns)
+	{
+		file.write(reinterpret_cast<const char *>(column.data()), rowCount * sizeof(float));
+	}
+
+	return static_cast<bool>(file);
+}
+
+void StatsStore::Upsert(const LeetifyUser &user, int32_t group)
+{
+	auto [it, inserted] = rows.try_emplace(user.steamID.ConvertToUint64(), steamIDs.size());
+	auto row = it->second;
+
+	if (inserted)
+	{
+		steamIDs.push_back(user.steamID.ConvertToUint64());
+		groups.push_back(group);
+
+		for (auto &column : columns)
+		{
+			column.push_back(0.0f);
+		}
+	}
+
+	groups[row] = group;
+
+	for (size_t i = 0; i < STAT_COUNT; i++)
+	{
+		columns[i][row] = GetStatOrNaN(user, static_cast<Stat>(i));
+	}
+}
+
+float StatsStore::Mean(Stat stat) const
+{
+	auto &column = Column(stat);
+	size_t present;
+	auto sum = SumColumn(column.data(), column.size(), present);
+
+	return present > 0 ? static_cast<float>(sum / present) : NAN;
+}
+
+float StatsStore::GroupMean(Stat stat, int32_t group) const
+{
+	auto &column = Column(stat);
+	size_t matched;
+	auto sum = SumGroup(column.data(), groups.data(), column.size(), group, matched);
+
+	return matched > 0 ? static_cast<float>(sum / matched) : NAN;
+}
+
+float StatsStore::CompareGroups(Stat stat, int32_t groupA, int32_t groupB) const
+{
+	return GroupMean(stat, groupA) - GroupMean(stat, groupB);
+}
+
+float StatsStore::PercentileRank(Stat stat, float value) const
+{
+	if (std::isnan(value))
+	{
+		return NAN;
+	}
+
+	auto &column = Column(stat);
+	size_t present;
+	auto below = CountBelow(column.data(), column.size(), value, present);
+
+	return present > 0 ? static_cast<float>(below) / present : NAN;
+}
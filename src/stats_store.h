@@ -0,0 +1,96 @@
+#pragma once
+
+#include "leetify_provider.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class Stat
+{
+	LeetifyRank,
+	Premier,
+	Faceit,
+	Aim,
+	Positioning,
+	Utility,
+	Clutch,
+	Opening,
+	CtLeetify,
+	TLeetify,
+	AccuracyEnemySpotted,
+	AccuracyHead,
+	CounterStrafingGoodShotsRatio,
+	CtOpeningAggressionSuccessRate,
+	CtOpeningDuelSuccessPercentage,
+	FlashbangHitFoeAvgDuration,
+	FlashbangHitFoePerFlashbang,
+	FlashbangHitFriendPerFlashbang,
+	FlashbangLeadingToKill,
+	FlashbangThrown,
+	HeFoesDamageAvg,
+	HeFriendsDamageAvg,
+	Preaim,
+	ReactionTime,
+	SprayAccuracy,
+	TOpeningAggressionSuccessRate,
+	TOpeningDuelSuccessPercentage,
+	TradedDeathsSuccessPercentage,
+	TradeKillOpportunitiesPerRound,
+	TradeKillsSuccessPercentage,
+	UtilityOnDeathAvg,
+	WinRate,
+	TotalMatches,
+	Count,
+};
+
+constexpr size_t STAT_COUNT = static_cast<size_t>(Stat::Count);
+
+float GetStat(const LeetifyUser &user, Stat stat);
+
+// Leetify reports stats a profile has no data for as 0, this is NaN for those instead. Stats where 0 is a real
+// value, e.g. ratings centred on 0, are returned as they are.
+float GetStatOrNaN(const LeetifyUser &user, Stat stat);
+
+// Structure-of-arrays copy of every player's stats, one contiguous column per stat, so aggregates over a whole
+// population are straight vectorized scans. Missing stats are stored as NaN and left out of every aggregate.
+// Each row also carries a group, e.g. the lobby ID, which only lives in memory.
+class StatsStore
+{
+  public:
+	bool Load(const std::string &path);
+	bool Save(const std::string &path) const;
+
+	// Adds the player's row or overwrites it with the newer profile
+	void Upsert(const LeetifyUser &user, int32_t group = 0);
+
+	size_t Size() const
+	{
+		return steamIDs.size();
+	}
+
+	const std::vector<float> &Column(Stat stat) const
+	{
+		return columns[static_cast<size_t>(stat)];
+	}
+
+	// NaN when no row has the stat
+	float Mean(Stat stat) const;
+
+	// NaN when no row in the group has the stat
+	float GroupMean(Stat stat, int32_t group) const;
+
+	// Difference between the two groups' means, positive when groupA is higher
+	float CompareGroups(Stat stat, int32_t groupA, int32_t groupB) const;
+
+	// Fraction of the players who have the stat that are strictly below value, from 0 to 1. NaN when value is
+	// missing or nobody has the stat.
+	float PercentileRank(Stat stat, float value) const;
+
+  private:
+	std::unordered_map<uint64, size_t> rows;
+	std::vector<uint64> steamIDs;
+	std::vector<int32_t> groups;
+	std::array<std::vector<float>, STAT_COUNT> columns;
+};
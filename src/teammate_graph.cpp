@@ -0,0 +1,338 @@
+#include "teammate_graph.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+bool TeammateGraph::Load(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	// Later records for the same pair override earlier ones and a count of 0 expires the edge. A player paired with
+	// themselves marks their profile as fetched.
+	Edge edge;
+	while (file.read(reinterpret_cast<char *>(&edge.a), sizeof(edge.a)) &&
+	       file.read(reinterpret_cast<char *>(&edge.b), sizeof(edge.b)) &&
+	       file.read(reinterpret_cast<char *>(&edge.matchCount), sizeof(edge.matchCount)))
+	{
+		loggedRecords++;
+		auto nodeA = NodeIndex(edge.a);
+
+		if (edge.a == edge.b)
+		{
+			MarkFetched(nodeA);
+		}
+		else
+		{
+			SetWeight(nodeA, NodeIndex(edge.b), edge.matchCount);
+		}
+	}
+
+	file.close();
+	unsaved.clear();
+
+	if (stale)
+	{
+		Rebuild();
+	}
+
+	if (loggedRecords > LOG_COMPACTION_RATIO * LiveRecords())
+	{
+		Compact(path);
+	}
+
+	return true;
+}
+
+static void WriteEdge(std::ofstream &file, uint64 a, uint64 b, int32_t matchCount)
+{
+	file.write(reinterpret_cast<const char *>(&a), sizeof(a));
+	file.write(reinterpret_cast<const char *>(&b), sizeof(b));
+	file.write(reinterpret_cast<const char *>(&matchCount), sizeof(matchCount));
+}
+
+bool TeammateGraph::Flush(const std::string &path)
+{
+	if (unsaved.empty())
+	{
+		return true;
+	}
+
+	if (loggedRecords + unsaved.size() > LOG_COMPACTION_RATIO * LiveRecords())
+	{
+		return Compact(path);
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::app);
+	if (!file)
+	{
+		return false;
+	}
+
+	for (const auto &edge : unsaved)
+	{
+		WriteEdge(file, edge.a, edge.b, edge.matchCount);
+	}
+
+	if (!file)
+	{
+		return false;
+	}
+
+	loggedRecords += unsaved.size();
+	unsaved.clear();
+	return true;
+}
+
+// Rewrites the log with one record per fetched player and live edge, through a temporary file so a crash midway
+// leaves the old log in place
+bool TeammateGraph::Compact(const std::string &path)
+{
+	auto temporaryPath = path + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+
+		for (uint32_t node = 0; node < steamIDs.size(); node++)
+		{
+			if (fetched[node])
+			{
+				WriteEdge(file, steamIDs[node], steamIDs[node], 0);
+			}
+		}
+
+		for (const auto &[key, matchCount] : weights)
+		{
+			WriteEdge(file, steamIDs[static_cast<uint32_t>(key >> 32)], steamIDs[static_cast<uint32_t>(key)],
+			          matchCount);
+		}
+
+		if (!file)
+		{
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error)
+	{
+		return false;
+	}
+
+	loggedRecords = LiveRecords();
+	unsaved.clear();
+	return true;
+}
+
+size_t TeammateGraph::LiveRecords() const
+{
+	return weights.size() + std::count(fetched.begin(), fetched.end(), true);
+}
+
+void TeammateGraph::AddProfile(const LeetifyUser &user)
+{
+	if (!user.success)
+	{
+		return;
+	}
+
+	auto node = NodeIndex(user.steamID.ConvertToUint64());
+	MarkFetched(node);
+
+	std::vector<uint32_t> current;
+	for (const auto &teammate : user.recentTeammates)
+	{
+		auto teammateNode = NodeIndex(teammate.steamID.ConvertToUint64());
+		if (teammateNode != node && teammate.matchCount > 0)
+		{
+			current.push_back(teammateNode);
+			SetWeight(node, teammateNode, teammate.matchCount);
+		}
+	}
+
+	// recent_teammates is a sliding window, anyone no longer in it hasn't played with this player lately
+	auto previous = neighbours[node];
+	for (auto neighbour : previous)
+	{
+		if (std::find(current.begin(), current.end(), neighbour) == current.end())
+		{
+			SetWeight(node, neighbour, 0);
+		}
+	}
+
+	// Off the render path, so lookups stay near constant time
+	if (stale)
+	{
+		Rebuild();
+	}
+}
+
+uint64 TeammateGraph::Component(CSteamID steamID)
+{
+	auto it = nodes.find(steamID.ConvertToUint64());
+	if (it == nodes.end())
+	{
+		return steamID.ConvertToUint64();
+	}
+
+	return steamIDs[Find(it->second)];
+}
+
+uint32_t TeammateGraph::NodeIndex(uint64 steamID)
+{
+	auto [it, inserted] = nodes.try_emplace(steamID, static_cast<uint32_t>(steamIDs.size()));
+	if (inserted)
+	{
+		steamIDs.push_back(steamID);
+		fetched.push_back(false);
+		neighbours.emplace_back();
+		parent.push_back(it->second);
+		rank.push_back(0);
+	}
+
+	return it->second;
+}
+
+void TeammateGraph::MarkFetched(uint32_t node)
+{
+	if (fetched[node])
+	{
+		return;
+	}
+
+	// Strong edges reported by fetched neighbours start counting now that both ends are known
+	fetched[node] = true;
+	unsaved.push_back({steamIDs[node], steamIDs[node], 0});
+
+	for (auto neighbour : neighbours[node])
+	{
+		if (Linked(node, neighbour, weights[EdgeKey(node, neighbour)]))
+		{
+			Union(node, neighbour);
+		}
+	}
+}
+
+void TeammateGraph::SetWeight(uint32_t a, uint32_t b, int matchCount)
+{
+	matchCount = (std::max)(matchCount, 0);
+
+	auto key = EdgeKey(a, b);
+	auto it = weights.find(key);
+	auto previous = it != weights.end() ? it->second : 0;
+
+	// The newest value replaces the old one, whichever side reported it
+	if (previous == matchCount)
+	{
+		return;
+	}
+
+	if (matchCount == 0)
+	{
+		weights.erase(it);
+		std::erase(neighbours[a], b);
+		std::erase(neighbours[b], a);
+	}
+	else
+	{
+		weights[key] = matchCount;
+
+		if (previous == 0)
+		{
+			neighbours[a].push_back(b);
+			neighbours[b].push_back(a);
+		}
+	}
+
+	unsaved.push_back({steamIDs[a], steamIDs[b], matchCount});
+
+	if (Linked(a, b, matchCount))
+	{
+		Union(a, b);
+	}
+	else if (Linked(a, b, previous))
+	{
+		stale = true;
+	}
+}
+
+bool TeammateGraph::Linked(uint32_t a, uint32_t b, int matchCount) const
+{
+	return matchCount >= MIN_PREMADE_MATCHES && fetched[a] && fetched[b];
+}
+
+void TeammateGraph::Rebuild()
+{
+	for (uint32_t node = 0; node < parent.size(); node++)
+	{
+		parent[node] = node;
+		rank[node] = 0;
+	}
+
+	for (const auto &[key, matchCount] : weights)
+	{
+		auto a = static_cast<uint32_t>(key >> 32);
+		auto b = static_cast<uint32_t>(key);
+
+		if (Linked(a, b, matchCount))
+		{
+			Union(a, b);
+		}
+	}
+
+	stale = false;
+}
+
+uint32_t TeammateGraph::Find(uint32_t node)
+{
+	// Path halving, every other node on the way up is pointed at its grandparent
+	while (parent[node] != node)
+	{
+		parent[node] = parent[parent[node]];
+		node = parent[node];
+	}
+
+	return node;
+}
+
+void TeammateGraph::Union(uint32_t a, uint32_t b)
+{
+	a = Find(a);
+	b = Find(b);
+
+	if (a == b)
+	{
+		return;
+	}
+
+	if (rank[a] < rank[b])
+	{
+		std::swap(a, b);
+	}
+
+	parent[b] = a;
+
+	if (rank[a] == rank[b])
+	{
+		rank[a]++;
+	}
+}
+
+uint64 TeammateGraph::EdgeKey(uint32_t a, uint32_t b)
+{
+	if (a > b)
+	{
+		std::swap(a, b);
+	}
+
+	return (static_cast<uint64>(a) << 32) | b;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "leetify_provider.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Who-queues-with-whom across every profile ever fetched. Every reported edge is kept and appended to a log on disk
+// so the graph survives between runs, but only strong edges between fetched players link components.
+class TeammateGraph
+{
+  public:
+	// Fewer recent matches together than this is a chance meeting in matchmaking, not a premade
+	static constexpr int MIN_PREMADE_MATCHES = 3;
+
+	// Once the log holds this many times more records than the graph has edges and fetched players, it is rewritten
+	// with only the latest ones
+	static constexpr size_t LOG_COMPACTION_RATIO = 4;
+
+	bool Load(const std::string &path);
+
+	// Appends edges added, reweighted or expired since the last flush, or compacts the log once it has grown too long
+	bool Flush(const std::string &path);
+
+	// Replaces the player's edges with their current recent teammates, teammates who dropped out of the window expire.
+	// Rebuilds every component when a strong link was weakened, O(V + E).
+	void AddProfile(const LeetifyUser &user);
+
+	// Representative of the player's component, players never seen are their own component
+	uint64 Component(CSteamID steamID);
+
+	size_t NodeCount() const
+	{
+		return steamIDs.size();
+	}
+
+  private:
+	struct Edge
+	{
+		uint64 a;
+		uint64 b;
+		int32_t matchCount;
+	};
+
+	uint32_t NodeIndex(uint64 steamID);
+	void MarkFetched(uint32_t node);
+	void SetWeight(uint32_t a, uint32_t b, int matchCount);
+	bool Linked(uint32_t a, uint32_t b, int matchCount) const;
+	void Rebuild();
+	bool Compact(const std::string &path);
+	size_t LiveRecords() const;
+	uint32_t Find(uint32_t node);
+	void Union(uint32_t a, uint32_t b);
+	static uint64 EdgeKey(uint32_t a, uint32_t b);
+
+	std::unordered_map<uint64, uint32_t> nodes;
+	std::vector<uint64> steamIDs;
+	std::vector<bool> fetched;
+	std::vector<std::vector<uint32_t>> neighbours;
+	std::vector<uint32_t> parent;
+	std::vector<uint8_t> rank;
+	std::unordered_map<uint64, int32_t> weights;
+	std::vector<Edge> unsaved;
+
+	// Records in the log on disk, superseded ones included
+	size_t loggedRecords = 0;
+
+	// Union-find can't split a component, so a weakened or expired link rebuilds them before the next lookup
+	bool stale = false;
+};
@@ -1,24 +1,66 @@
 #include "ui.h"
 #include "ftxui/dom/elements.hpp"
 #include "ftxui/dom/node.hpp"
-#include "ftxui/dom/table.hpp"
 #include "ftxui/screen/color.hpp"
 #include "ftxui/screen/screen.hpp"
+#include "ftxui/screen/terminal.hpp"
 #include "leetify_provider.h"
 #include "main.h"
+#include "stats_store.h"
 #include "steam_api.h"
+#include "teammate_graph.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <deque>
 #include <iomanip>
 #include <ios>
 #include <iosfwd>
 #include <map>
-#include <queue>
-#include <set>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+// Profiles needed in the history before colours switch from fixed cut-offs to percentiles
+constexpr size_t MIN_PERCENTILE_POPULATION = 500;
+
+// Status messages shown below the table, older ones scroll off
+constexpr size_t MAX_STATUS_LINES = 3;
+
+// Where each player stands in the stats history, for the columns coloured by percentile
+struct PercentileRanks
+{
+	float aim;
+	float reactionTime;
+	float preaim;
+	float accuracyHead;
+};
+
+static PercentileRanks percentileRanks(const LeetifyUser &user, const StatsStore &statsHistory)
+{
+	return {statsHistory.PercentileRank(Stat::Aim, GetStatOrNaN(user, Stat::Aim)),
+	        statsHistory.PercentileRank(Stat::ReactionTime, GetStatOrNaN(user, Stat::ReactionTime)),
+	        statsHistory.PercentileRank(Stat::Preaim, GetStatOrNaN(user, Stat::Preaim)),
+	        statsHistory.PercentileRank(Stat::AccuracyHead, GetStatOrNaN(user, Stat::AccuracyHead))};
+}
+
+// Which of the colour cut-offs a percentile rank has passed, a row only looks different when this changes
+static int colourBand(float rank)
+{
+	int band = 0;
+
+	for (auto cutoff : {0.01f, 0.25f, 0.75f, 0.9f, 0.99f})
+	{
+		band += rank >= cutoff;
+	}
+
+	return band;
+}
+
 static std::string roundTo(float value, int decimalPlaces)
 {
 	std::stringstream stream;
@@ -26,97 +68,39 @@ static std::string roundTo(float value, int decimalPlaces)
 	return stream.str();
 }
 
-void processAndSortUsers(std::vector<LeetifyUser> &leetifyUsers)
+void processAndSortUsers(std::vector<LeetifyUser> &leetifyUsers, TeammateGraph &teammateGraph)
 {
 	int nextLobbyID = 1;
 
-	auto findUserBySteamID = [&leetifyUsers](CSteamID steamID) {
-		return std::find_if(leetifyUsers.begin(), leetifyUsers.end(),
-		                    [steamID](const LeetifyUser &u) { return u.steamID == steamID; });
-	};
-
-	// First, create a bidirectional relationship map
-	// If A has B as a teammate, both should be in the same lobby
-	std::map<CSteamID, std::set<CSteamID>> teammateConnections;
+	// Players that share a component in the persistent teammate graph are in the same lobby, which also
+	// catches premades linked only through players fetched in earlier sessions
+	std::map<uint64, int> componentSizes;
 
-	// Build connections in both directions
 	for (const auto &user : leetifyUsers)
 	{
-		// Add connections from this user's teammates list
-		for (const auto &teammateInfo : user.recentTeammates)
-		{
-			// Only add connections for teammates that exist in our list
-			if (findUserBySteamID(teammateInfo.steamID) != leetifyUsers.end())
-			{
-				teammateConnections[user.steamID].insert(teammateInfo.steamID);
-				teammateConnections[teammateInfo.steamID].insert(user.steamID);
-			}
-		}
+		componentSizes[teammateGraph.Component(user.steamID)]++;
 	}
 
-	// Now assign lobby IDs using the bidirectional connections
-	std::map<CSteamID, int> steamIDToLobbyID;
+	std::map<uint64, int> componentToLobbyID;
 
 	for (auto &user : leetifyUsers)
 	{
-		auto userID = user.steamID;
+		auto component = teammateGraph.Component(user.steamID);
 
-		// If this user already has a lobby ID, skip
-		if (steamIDToLobbyID.find(userID) != steamIDToLobbyID.end())
+		// Nobody else shown is connected to this user, assign single-player lobby (0)
+		if (componentSizes[component] < 2)
 		{
-			user.lobbyID = steamIDToLobbyID[userID];
-			continue;
-		}
-
-		// No lobby ID yet, check if this user has any teammates
-		if (teammateConnections[userID].empty())
-		{
-			// No teammates, assign single-player lobby (0)
 			user.lobbyID = 0;
-			steamIDToLobbyID[userID] = 0;
 			continue;
 		}
 
-		// Create a new lobby with teammates
-		auto lobbyID = nextLobbyID++;
-		user.lobbyID = lobbyID;
-		steamIDToLobbyID[userID] = lobbyID;
-
-		// Use a queue to find all connected teammates (breadth-first search)
-		std::queue<CSteamID> toProcess;
-		std::set<CSteamID> processed;
-		toProcess.push(userID);
-		processed.insert(userID);
-
-		while (!toProcess.empty())
+		auto [it, inserted] = componentToLobbyID.try_emplace(component, nextLobbyID);
+		if (inserted)
 		{
-			auto &currentID = toProcess.front();
-			toProcess.pop();
-
-			// Process all teammates of the current user
-			for (auto &teammateID : teammateConnections[currentID])
-			{
-				// Skip already processed teammates
-				if (processed.find(teammateID) != processed.end())
-				{
-					continue;
-				}
-
-				// Mark as processed
-				processed.insert(teammateID);
-
-				// Add to process queue
-				toProcess.push(teammateID);
-
-				// Assign same lobby ID
-				auto teammateIt = findUserBySteamID(teammateID);
-				if (teammateIt != leetifyUsers.end())
-				{
-					teammateIt->lobbyID = lobbyID;
-					steamIDToLobbyID[teammateID] = lobbyID;
-				}
-			}
+			nextLobbyID++;
 		}
+
+		user.lobbyID = it->second;
 	}
 
 	// Sort users by lobby ID and then by Leetify rating
@@ -140,175 +124,362 @@ void processAndSortUsers(std::vector<LeetifyUser> &leetifyUsers)
 	});
 }
 
-void renderTable(CSteamID mySteamID, std::vector<LeetifyUser> leetifyUsers)
+// Formats one player's cells, only called when the row's fingerprint changed since the last frame. Colours use
+// fixed cut-offs when there are no percentile ranks yet.
+static std::vector<ftxui::Element> buildRow(const LeetifyUser &user, CSteamID mySteamID, const std::string &name,
+                                            const std::string &teammatesStr, long long playedAgoMinutes,
+                                            long long daysSinceFirstMatch, const PercentileRanks *ranks)
 {
 	using namespace ftxui;
 
-	auto findUserBySteamID = [&leetifyUsers](CSteamID steamID) {
-		return std::find_if(leetifyUsers.begin(), leetifyUsers.end(),
-		                    [steamID](const LeetifyUser &u) { return u.steamID == steamID; });
-	};
+	std::vector<Element> row;
+	auto profileUrl = "https://leetify.com/app/profile/" + std::to_string(user.steamID.ConvertToUint64());
 
-	auto now = std::chrono::system_clock::now();
-	auto lastSeenLobbyID = -1;
-	std::vector<std::vector<Element>> table_data;
+	row.push_back(hbox({
+	    text(" "),
+	    text(name + " ") | hyperlink(profileUrl) | color(user.steamID == mySteamID ? Color::Yellow : Color::White),
+	}));
 
-	table_data.push_back({text(" Name ") | bold | color(Color::Cyan), text(" Leetify ") | bold | color(Color::Cyan),
-	                      text(" Premier ") | bold | color(Color::Cyan), text(" Aim ") | bold | color(Color::Cyan),
-	                      text(" Reaction ") | bold | color(Color::Cyan), text(" Preaim ") | bold | color(Color::Cyan),
-	                      text(" HS% ") | bold | color(Color::Cyan), text(" Win% ") | bold | color(Color::Cyan),
-	                      text(" Matches ") | bold | color(Color::Cyan),
-	                      text(" First Match ") | bold | color(Color::Cyan),
-	                      text(" FACEIT ") | bold | color(Color::Cyan), text(" Time ") | bold | color(Color::Cyan),
-	                      text(" Bans ") | bold | color(Color::Cyan), text(" Teammates ") | bold | color(Color::Cyan)});
+	if (!user.success)
+	{
+		row.push_back(user.pending ? text(" ... ") | color(Color::GrayDark) : text(" N/A ") | color(Color::Magenta));
+		row.push_back(text(" ? "));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		row.push_back(text(" " + std::to_string(playedAgoMinutes) + "m ago "));
+		row.push_back(text(""));
+		row.push_back(text(""));
+		return row;
+	}
 
-	for (const auto &user : leetifyUsers)
+	auto leetifyColor = user.ranks.leetify >= 5    ? Color::Yellow
+	                    : user.ranks.leetify >= 1  ? Color::Green
+	                    : user.ranks.leetify <= -1 ? Color::Red
+	                                          : Color::White;
+
+	auto premierColor = user.ranks.premier >= 30000   ? Color::Yellow
+	                    : user.ranks.premier >= 25000 ? Color::Red
+	                    : user.ranks.premier >= 20000 ? Color::Magenta
+	                    : user.ranks.premier >= 15000 ? Color::Blue
+	                    : user.ranks.premier >= 10000 ? Color::Cyan
+	                                                  : Color::White;
+
+	auto aimColor = user.rating.aim >= 85 ? Color::Red : user.rating.aim >= 60 ? Color::Green : Color::White;
+
+	if (ranks)
 	{
-		if (lastSeenLobbyID != user.lobbyID)
+		aimColor = ranks->aim >= 0.99f ? Color::Red : ranks->aim >= 0.75f ? Color::Green : Color::White;
+	}
+
+	auto posColor = user.rating.positioning >= 60 ? Color::Green : Color::White;
+	auto winsColor = user.winRate >= 55 ? Color::Green : user.winRate <= 45 ? Color::Red : Color::White;
+
+	auto faceitColor = user.ranks.faceit >= 2001   ? Color::Red
+	                   : user.ranks.faceit >= 1701 ? Color::Magenta
+	                                               : Color::White;
+
+	auto reactionColor = user.skills.reaction_time < 300   ? Color::Red
+	                     : user.skills.reaction_time < 450 ? Color::Green
+	                     : user.skills.reaction_time > 650 ? Color::Yellow
+	                                                       : Color::White;
+
+	auto preaimColor = user.skills.preaim < 3 ? Color::Red : user.skills.preaim < 10 ? Color::Green : Color::White;
+
+	auto hsColor = user.skills.accuracy_head >= 20 ? Color::Green : Color::White;
+
+	if (ranks)
+	{
+		// Lower is better for reaction time and preaim
+		reactionColor = ranks->reactionTime < 0.01f   ? Color::Red
+		                : ranks->reactionTime < 0.25f ? Color::Green
+		                : ranks->reactionTime >= 0.9f ? Color::Yellow
+		                                              : Color::White;
+
+		preaimColor = ranks->preaim < 0.01f ? Color::Red : ranks->preaim < 0.25f ? Color::Green : Color::White;
+
+		hsColor = ranks->accuracyHead >= 0.75f ? Color::Green : Color::White;
+	}
+
+	row.push_back(text((user.ranks.leetify >= 0.0 ? " +" : " ") + roundTo(user.ranks.leetify, 2) + " ") |
+	              color(leetifyColor) | bold);
+	row.push_back(text(" " + (user.ranks.premier <= 0 ? "?" : std::to_string(user.ranks.premier)) + " ") |
+	              color(premierColor));
+	row.push_back(text(" " + std::to_string((int)user.rating.aim) + " ") | color(aimColor));
+
+	row.push_back(text(" " + std::to_string((int)user.skills.reaction_time) + "ms") | color(reactionColor));
+	row.push_back(text(" " + roundTo(user.skills.preaim, 2) + "° ") | color(preaimColor));
+	row.push_back(text(" " + std::to_string((int)user.skills.accuracy_head) + "% ") | color(hsColor));
+
+	row.push_back(text(" " + std::to_string((int)user.winRate) + "% ") | color(winsColor));
+	row.push_back(text(std::to_string(user.totalMatches) + " ") |
+	              color(user.totalMatches < 100 ? Color::Red : Color::White));
+
+	if (daysSinceFirstMatch > 365)
+	{
+		row.push_back(text(" " + std::to_string(daysSinceFirstMatch / 365) + " years "));
+	}
+	else if (daysSinceFirstMatch > 60)
+	{
+		row.push_back(text(" " + std::to_string(daysSinceFirstMatch / 30) + " months ") | color(Color::Yellow));
+	}
+	else
+	{
+		row.push_back(text(" " + std::to_string(daysSinceFirstMatch) + " days ") | color(Color::Red));
+	}
+
+	if (user.ranks.faceit > 0)
+	{
+		row.push_back(text(std::to_string(user.ranks.faceit) + " ") | color(faceitColor));
+	}
+	else
+	{
+		row.push_back(text(""));
+	}
+
+	if (user.steamID == mySteamID)
+	{
+		row.push_back(text(" you ") | color(Color::GrayDark));
+	}
+	else if (playedAgoMinutes >= 1440)
+	{
+		row.push_back(text(" >" + std::to_string(playedAgoMinutes / 1440) + "d ago ") | color(Color::GrayDark));
+	}
+	else if (playedAgoMinutes >= 180)
+	{
+		row.push_back(text(" >" + std::to_string(playedAgoMinutes / 60) + "h ago ") | color(Color::GrayDark));
+	}
+	else
+	{
+		row.push_back(text(" " + std::to_string(playedAgoMinutes) + "m ago "));
+	}
+
+	if (!user.bans.empty())
+	{
+		std::string bansStr;
+		for (auto i = 0; i < user.bans.size(); i++)
 		{
-			if (lastSeenLobbyID != -1)
+			bansStr += user.bans[i];
+			if (i < user.bans.size() - 1)
 			{
-				table_data.push_back({text("")});
+				bansStr += ", ";
 			}
-
-			lastSeenLobbyID = user.lobbyID;
 		}
+		row.push_back(text(" " + bansStr) | color(Color::Red));
+	}
+	else
+	{
+		row.push_back(text(""));
+	}
+	row.push_back(text(" " + teammatesStr + " "));
 
-		std::vector<Element> row;
-		auto playedAgoMinutes = std::chrono::duration_cast<std::chrono::minutes>(
-		                            now - std::chrono::system_clock::from_time_t(user.playedTime))
-		                            .count();
+	return row;
+}
+
+template <typename T> static void appendFingerprint(std::string &fingerprint, const T &value)
+{
+	fingerprint.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
 
-		auto profileUrl = "https://leetify.com/app/profile/" + std::to_string(user.steamID.ConvertToUint64());
+// Everything a row's cells are formatted from, including its lobby assignment and the colour bands its percentile
+// ranks fall in, which move as the stats history grows
+static std::string rowFingerprint(const LeetifyUser &user, const std::string &name, const std::string &teammatesStr,
+                                  long long playedAgoMinutes, long long daysSinceFirstMatch,
+                                  const PercentileRanks *ranks)
+{
+	std::string fingerprint = name + '\0' + teammatesStr + '\0';
 
-		row.push_back(hbox({
-		    text(" "),
-		    text(GetPersonaName(user) + " ") | hyperlink(profileUrl) |
-		        color(user.steamID == mySteamID ? Color::Yellow : Color::White),
-		}));
+	for (const auto &ban : user.bans)
+	{
+		fingerprint += ban + '\0';
+	}
 
-		if (!user.success)
-		{
-			row.push_back(text(" N/A ") | color(Color::Magenta));
-			row.push_back(text(" ? "));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			row.push_back(text(" " + std::to_string(playedAgoMinutes) + "m ago "));
-			row.push_back(text(""));
-			row.push_back(text(""));
-			table_data.push_back(row);
-			continue;
-		}
+	appendFingerprint(fingerprint, user.lobbyID);
+	appendFingerprint(fingerprint, user.success);
+	appendFingerprint(fingerprint, user.pending);
+	appendFingerprint(fingerprint, user.ranks);
+	appendFingerprint(fingerprint, user.rating.aim);
+	appendFingerprint(fingerprint, user.skills.reaction_time);
+	appendFingerprint(fingerprint, user.skills.preaim);
+	appendFingerprint(fingerprint, user.skills.accuracy_head);
+	appendFingerprint(fingerprint, user.winRate);
+	appendFingerprint(fingerprint, user.totalMatches);
+	appendFingerprint(fingerprint, playedAgoMinutes);
+	appendFingerprint(fingerprint, daysSinceFirstMatch);
+	appendFingerprint(fingerprint, ranks != nullptr);
+
+	if (ranks)
+	{
+		appendFingerprint(fingerprint, colourBand(ranks->aim));
+		appendFingerprint(fingerprint, colourBand(ranks->reactionTime));
+		appendFingerprint(fingerprint, colourBand(ranks->preaim));
+		appendFingerprint(fingerprint, colourBand(ranks->accuracyHead));
+	}
 
-		auto leetifyColor = user.ranks.leetify >= 5    ? Color::Yellow
-		                    : user.ranks.leetify >= 1  ? Color::Green
-		                    : user.ranks.leetify <= -1 ? Color::Red
-		                                          : Color::White;
+	return fingerprint;
+}
 
-		auto premierColor = user.ranks.premier >= 30000   ? Color::Yellow
-		                    : user.ranks.premier >= 25000 ? Color::Red
-		                    : user.ranks.premier >= 20000 ? Color::Magenta
-		                    : user.ranks.premier >= 15000 ? Color::Blue
-		                    : user.ranks.premier >= 10000 ? Color::Cyan
-		                                                  : Color::White;
+struct CachedRow
+{
+	std::string fingerprint;
+	std::vector<ftxui::Element> cells;
+	std::vector<int> widths;
 
-		auto aimColor = user.rating.aim >= 85 ? Color::Red : user.rating.aim >= 60 ? Color::Green : Color::White;
+	// Drawn line, empty until drawn at the current column widths
+	std::string line;
+};
 
-		auto posColor = user.rating.positioning >= 60 ? Color::Green : Color::White;
-		auto winsColor = user.winRate >= 55 ? Color::Green : user.winRate <= 45 ? Color::Red : Color::White;
+// Rows from the previous frame keyed by SteamID, and the layout their lines were drawn with
+static std::unordered_map<uint64, CachedRow> s_rowCache;
+static std::vector<int> s_columnWidths;
+static int s_tableWidthLimit = 0;
+static std::vector<std::string> s_tableFrame;
 
-		auto faceitColor = user.ranks.faceit >= 2001   ? Color::Red
-		                   : user.ranks.faceit >= 1701 ? Color::Magenta
-		                                               : Color::White;
+static bool isRightAligned(size_t column)
+{
+	// leetify, premier, aim, preaim, hs, win, matches, faceit
+	return column == 1 || column == 2 || column == 3 || column == 5 || column == 6 || column == 7 || column == 8 ||
+	       column == 10;
+}
 
-		auto reactionColor = user.skills.reaction_time < 300   ? Color::Red
-		                     : user.skills.reaction_time < 450 ? Color::Green
-		                     : user.skills.reaction_time > 650 ? Color::Yellow
-		                                                       : Color::White;
+static std::vector<int> cellWidths(const std::vector<ftxui::Element> &cells)
+{
+	std::vector<int> widths;
 
-		auto preaimColor = user.skills.preaim < 3 ? Color::Red : user.skills.preaim < 10 ? Color::Green : Color::White;
+	for (const auto &cell : cells)
+	{
+		cell->ComputeRequirement();
+		widths.push_back(cell->requirement().min_x);
+	}
 
-		auto hsColor = user.skills.accuracy_head >= 20 ? Color::Green : Color::White;
+	return widths;
+}
 
-		row.push_back(text((user.ranks.leetify >= 0.0 ? " +" : " ") + roundTo(user.ranks.leetify, 2) + " ") |
-		              color(leetifyColor) | bold);
-		row.push_back(text(" " + (user.ranks.premier <= 0 ? "?" : std::to_string(user.ranks.premier)) + " ") |
-		              color(premierColor));
-		row.push_back(text(" " + std::to_string((int)user.rating.aim) + " ") | color(aimColor));
+static int tableWidth(const std::vector<int> &columnWidths)
+{
+	auto width = 1;
 
-		row.push_back(text(" " + std::to_string((int)user.skills.reaction_time) + "ms") | color(reactionColor));
-		row.push_back(text(" " + roundTo(user.skills.preaim, 2) + "° ") | color(preaimColor));
-		row.push_back(text(" " + std::to_string((int)user.skills.accuracy_head) + "% ") | color(hsColor));
+	for (auto columnWidth : columnWidths)
+	{
+		width += columnWidth + 1;
+	}
 
-		row.push_back(text(" " + std::to_string((int)user.winRate) + "% ") | color(winsColor));
-		row.push_back(text(std::to_string(user.totalMatches) + " ") |
-		              color(user.totalMatches < 100 ? Color::Red : Color::White));
+	return width;
+}
 
-		auto daysSinceFirstMatch =
-		    std::chrono::duration_cast<std::chrono::hours>(now - user.firstMatchDate).count() / 24;
+// Lays one row out between vertical separators, clipped to maxWidth so it never wraps
+static std::string drawRow(const std::vector<ftxui::Element> &cells, const std::vector<int> &columnWidths,
+                           int maxWidth)
+{
+	using namespace ftxui;
 
-		if (daysSinceFirstMatch > 365)
-		{
-			row.push_back(text(" " + std::to_string(daysSinceFirstMatch / 365) + " years "));
-		}
-		else if (daysSinceFirstMatch > 60)
-		{
-			row.push_back(text(" " + std::to_string(daysSinceFirstMatch / 30) + " months ") | color(Color::Yellow));
-		}
-		else
-		{
-			row.push_back(text(" " + std::to_string(daysSinceFirstMatch) + " days ") | color(Color::Red));
-		}
+	Elements parts{text("│")};
 
-		if (user.ranks.faceit > 0)
-		{
-			row.push_back(text(std::to_string(user.ranks.faceit) + " ") | color(faceitColor));
-		}
-		else
+	for (size_t column = 0; column < columnWidths.size(); column++)
+	{
+		auto cell = column < cells.size() ? cells[column] : text("");
+		if (isRightAligned(column))
 		{
-			row.push_back(text(""));
+			cell = align_right(cell);
 		}
 
-		if (user.steamID == mySteamID)
-		{
-			row.push_back(text(" you ") | color(Color::GrayDark));
-		}
-		else if (playedAgoMinutes >= 1440)
-		{
-			row.push_back(text(" >" + std::to_string(playedAgoMinutes / 1440) + "d ago ") | color(Color::GrayDark));
-		}
-		else if (playedAgoMinutes >= 180)
-		{
-			row.push_back(text(" >" + std::to_string(playedAgoMinutes / 60) + "h ago ") | color(Color::GrayDark));
-		}
-		else
+		parts.push_back(cell | size(WIDTH, EQUAL, columnWidths[column]));
+		parts.push_back(text("│"));
+	}
+
+	auto document = hbox(std::move(parts));
+	auto screen = Screen::Create(Dimension::Fixed((std::min)(tableWidth(columnWidths), maxWidth)), Dimension::Fixed(1));
+	Render(screen, document);
+
+	return screen.ToString();
+}
+
+static std::string drawBorder(const char *left, const char *middle, const char *right,
+                              const std::vector<int> &columnWidths, int maxWidth)
+{
+	std::string border;
+	auto width = 0;
+
+	auto append = [&](const char *glyph) {
+		if (width < maxWidth)
 		{
-			row.push_back(text(" " + std::to_string(playedAgoMinutes) + "m ago "));
+			border += glyph;
+			width++;
 		}
+	};
 
-		if (!user.bans.empty())
+	append(left);
+
+	for (size_t column = 0; column < columnWidths.size(); column++)
+	{
+		for (auto i = 0; i < columnWidths[column]; i++)
 		{
-			std::string bansStr;
-			for (auto i = 0; i < user.bans.size(); i++)
-			{
-				bansStr += user.bans[i];
-				if (i < user.bans.size() - 1)
-				{
-					bansStr += ", ";
-				}
-			}
-			row.push_back(text(" " + bansStr) | color(Color::Red));
+			append("─");
 		}
-		else
+
+		append(column + 1 < columnWidths.size() ? middle : right);
+	}
+
+	return border;
+}
+
+// Cuts plain text at maxWidth columns without splitting a UTF-8 sequence
+static std::string clampToWidth(const std::string &line, int maxWidth)
+{
+	auto width = 0;
+
+	for (size_t i = 0; i < line.size(); i++)
+	{
+		if ((static_cast<unsigned char>(line[i]) & 0xC0) != 0x80 && width++ == maxWidth)
 		{
-			row.push_back(text(""));
+			return line.substr(0, i);
 		}
+	}
+
+	return line;
+}
+
+// Only rows whose fingerprint changed are formatted and drawn again, and only when the column widths change is
+// every row redrawn
+std::vector<std::string> renderTable(CSteamID mySteamID, const std::vector<LeetifyUser> &leetifyUsers,
+                                     const StatsStore &statsHistory, int maxWidth)
+{
+	using namespace ftxui;
+
+	auto findUserBySteamID = [&leetifyUsers](CSteamID steamID) {
+		return std::find_if(leetifyUsers.begin(), leetifyUsers.end(),
+		                    [steamID](const LeetifyUser &u) { return u.steamID == steamID; });
+	};
+
+	auto usePercentiles = statsHistory.Size() >= MIN_PERCENTILE_POPULATION;
+
+	static const std::vector<Element> headerCells = {
+	    text(" Name ") | bold | color(Color::Cyan),        text(" Leetify ") | bold | color(Color::Cyan),
+	    text(" Premier ") | bold | color(Color::Cyan),     text(" Aim ") | bold | color(Color::Cyan),
+	    text(" Reaction ") | bold | color(Color::Cyan),    text(" Preaim ") | bold | color(Color::Cyan),
+	    text(" HS% ") | bold | color(Color::Cyan),         text(" Win% ") | bold | color(Color::Cyan),
+	    text(" Matches ") | bold | color(Color::Cyan),     text(" First Match ") | bold | color(Color::Cyan),
+	    text(" FACEIT ") | bold | color(Color::Cyan),      text(" Time ") | bold | color(Color::Cyan),
+	    text(" Bans ") | bold | color(Color::Cyan),        text(" Teammates ") | bold | color(Color::Cyan)};
+	static const auto headerWidths = cellWidths(headerCells);
+
+	auto now = std::chrono::system_clock::now();
+	auto columnWidths = headerWidths;
+	std::unordered_map<uint64, CachedRow> rowCache;
+
+	for (const auto &user : leetifyUsers)
+	{
+		auto playedAgoMinutes = std::chrono::duration_cast<std::chrono::minutes>(
+		                            now - std::chrono::system_clock::from_time_t(user.playedTime))
+		                            .count();
+
+		auto daysSinceFirstMatch =
+		    std::chrono::duration_cast<std::chrono::hours>(now - user.firstMatchDate).count() / 24;
 
 		std::string teammatesStr;
 		auto firstTeammate = true;
@@ -337,38 +508,255 @@ void renderTable(CSteamID mySteamID, std::vector<LeetifyUser> leetifyUsers)
 			}
 		}
 
-		row.push_back(text(" " + teammatesStr + " "));
+		std::optional<PercentileRanks> ranks;
+		if (usePercentiles && user.success)
+		{
+			ranks = percentileRanks(user, statsHistory);
+		}
+
+		auto name = GetPersonaName(user);
+		auto fingerprint = rowFingerprint(user, name, teammatesStr, playedAgoMinutes, daysSinceFirstMatch,
+		                                  ranks ? &*ranks : nullptr);
+
+		// Unchanged rows reuse last frame's elements instead of being formatted again
+		auto cached = s_rowCache.find(user.steamID.ConvertToUint64());
+		if (cached == s_rowCache.end() || cached->second.fingerprint != fingerprint)
+		{
+			auto cells = buildRow(user, mySteamID, name, teammatesStr, playedAgoMinutes, daysSinceFirstMatch,
+			                      ranks ? &*ranks : nullptr);
+			auto widths = cellWidths(cells);
+			cached = s_rowCache
+			             .insert_or_assign(user.steamID.ConvertToUint64(),
+			                               CachedRow{fingerprint, std::move(cells), std::move(widths), ""})
+			             .first;
+		}
 
-		table_data.push_back(row);
+		for (size_t column = 0; column < cached->second.widths.size() && column < columnWidths.size(); column++)
+		{
+			columnWidths[column] = (std::max)(columnWidths[column], cached->second.widths[column]);
+		}
+
+		rowCache.insert(*cached);
 	}
 
-	auto table = Table(table_data);
+	// Players no longer shown are dropped
+	s_rowCache = std::move(rowCache);
 
-	table.SelectAll().SeparatorVertical(LIGHT);
-	table.SelectAll().Border(LIGHT);
-	table.SelectRow(0).BorderBottom(LIGHT);
+	// A wider cell or a resized terminal moves every column boundary
+	if (columnWidths != s_columnWidths || maxWidth != s_tableWidthLimit)
+	{
+		for (auto &[steamID, row] : s_rowCache)
+		{
+			row.line.clear();
+		}
 
-	table.SelectColumn(1).DecorateCells(align_right);  // leetify
-	table.SelectColumn(2).DecorateCells(align_right);  // premier
-	table.SelectColumn(3).DecorateCells(align_right);  // aim
-	table.SelectColumn(5).DecorateCells(align_right);  // preaim
-	table.SelectColumn(6).DecorateCells(align_right);  // hs
-	table.SelectColumn(7).DecorateCells(align_right);  // win
-	table.SelectColumn(8).DecorateCells(align_right);  // matches
-	table.SelectColumn(10).DecorateCells(align_right); // faceit
+		s_columnWidths = columnWidths;
+		s_tableWidthLimit = maxWidth;
+		s_tableFrame = {drawBorder("┌", "┬", "┐", columnWidths, maxWidth), drawRow(headerCells, columnWidths, maxWidth),
+		                drawBorder("├", "┼", "┤", columnWidths, maxWidth),
+		                drawRow({}, columnWidths, maxWidth), drawBorder("└", "┴", "┘", columnWidths, maxWidth)};
+	}
 
-	auto document = table.Render();
-	auto screen = Screen::Create(Dimension::Fit(document));
-	Render(screen, document);
-	screen.Print();
+	std::vector<std::string> lines(s_tableFrame.begin(), s_tableFrame.begin() + 3);
+	auto lastSeenLobbyID = -1;
+
+	for (const auto &user : leetifyUsers)
+	{
+		if (lastSeenLobbyID != user.lobbyID)
+		{
+			if (lastSeenLobbyID != -1)
+			{
+				lines.push_back(s_tableFrame[3]);
+			}
+
+			lastSeenLobbyID = user.lobbyID;
+		}
+
+		auto &row = s_rowCache[user.steamID.ConvertToUint64()];
+		if (row.line.empty())
+		{
+			row.line = drawRow(row.cells, columnWidths, maxWidth);
+		}
+
+		lines.push_back(row.line);
+	}
+
+	lines.push_back(s_tableFrame[4]);
+	return lines;
+}
+
+// Signed, or ? when nobody had the stat
+static std::string signedRoundTo(float value, int decimalPlaces)
+{
+	if (std::isnan(value))
+	{
+		return "?";
+	}
+
+	return (value >= 0.0f ? "+" : "") + roundTo(value, decimalPlaces);
+}
+
+std::string renderLobbyAverages(const std::vector<LeetifyUser> &leetifyUsers)
+{
+	StatsStore lobbyStats;
+	std::map<int, int> lobbySizes;
+
+	for (const auto &user : leetifyUsers)
+	{
+		if (user.success && user.lobbyID > 0)
+		{
+			lobbyStats.Upsert(user, user.lobbyID);
+			lobbySizes[user.lobbyID]++;
+		}
+	}
+
+	if (lobbySizes.empty())
+	{
+		return "";
+	}
+
+	std::string averages = "Lobby averages:";
+
+	for (const auto &[lobbyID, size] : lobbySizes)
+	{
+		auto leetify = lobbyStats.GroupMean(Stat::LeetifyRank, lobbyID);
+		auto aim = lobbyStats.GroupMean(Stat::Aim, lobbyID);
+		averages += " #" + std::to_string(lobbyID) + " " + signedRoundTo(leetify, 2) + " (aim " +
+		            (std::isnan(aim) ? "?" : std::to_string(static_cast<int>(aim))) + ")";
+	}
+
+	// The two largest premades are most likely the cores of opposing teams
+	if (lobbySizes.size() >= 2)
+	{
+		std::vector<std::pair<int, int>> bySize(lobbySizes.begin(), lobbySizes.end());
+		std::stable_sort(bySize.begin(), bySize.end(),
+		                 [](const auto &a, const auto &b) { return a.second > b.second; });
+
+		auto a = bySize[0].first;
+		auto b = bySize[1].first;
+		averages += " | #" + std::to_string(a) + " vs #" + std::to_string(b) + ": " +
+		            signedRoundTo(lobbyStats.CompareGroups(Stat::LeetifyRank, a, b), 2) + " rating, " +
+		            signedRoundTo(lobbyStats.CompareGroups(Stat::Aim, a, b), 0) + " aim";
+	}
+
+	return averages;
+}
+
+// Guards everything presentFrame touches, status messages arrive from the fetch's threads
+static std::mutex s_frameMutex;
+
+// Last table drawn by Render and the status messages below it
+static std::vector<std::string> s_tableLines;
+static std::deque<std::string> s_statusLines;
+
+// Lines currently on the terminal, the cursor sits at the start of the line below them
+static std::vector<std::string> s_frameLines;
+static int s_frameWidth = 0;
+
+// Rewrites only the lines that differ from the previous frame. Called with s_frameMutex held.
+static void presentFrame(int width, int height)
+{
+	auto lines = s_tableLines;
+	lines.insert(lines.end(), s_statusLines.begin(), s_statusLines.end());
+
+	// Cursor movement can't reach lines scrolled off the top, so the frame never gets taller than the terminal. The
+	// last line that fits says how much was left out.
+	if (height > 1 && lines.size() >= static_cast<size_t>(height))
+	{
+		auto hidden = lines.size() - (height - 2);
+		lines.resize(height - 1);
+		lines.back() = clampToWidth("… " + std::to_string(hidden) + " more rows (enlarge the terminal)", width);
+	}
+
+	std::string output;
+
+	// The terminal may have rewrapped the old frame, start over on a cleared screen
+	if (width != s_frameWidth && !s_frameLines.empty())
+	{
+		output += "\x1b[2J\x1b[H";
+		s_frameLines.clear();
+	}
+
+	if (!s_frameLines.empty())
+	{
+		output += "\x1b[" + std::to_string(s_frameLines.size()) + "A";
+	}
+
+	auto frameHeight = (std::max)(lines.size(), s_frameLines.size());
+
+	for (size_t i = 0; i < frameHeight; i++)
+	{
+		if (i >= lines.size())
+		{
+			// Left over from a taller frame
+			output += "\x1b[2K";
+		}
+		else if (i >= s_frameLines.size() || lines[i] != s_frameLines[i])
+		{
+			output += "\r" + lines[i] + "\x1b[K";
+		}
+
+		output += "\r\n";
+	}
+
+	if (lines.size() < s_frameLines.size())
+	{
+		output += "\x1b[" + std::to_string(s_frameLines.size() - lines.size()) + "A";
+	}
+
+	fwrite(output.data(), 1, output.size(), stdout);
+	fflush(stdout);
+
+	s_frameLines = std::move(lines);
+	s_frameWidth = width;
 }
 
-void Render(CSteamID mySteamID, std::vector<LeetifyUser> leetifyUsers)
+void PrintStatus(const std::string &message)
 {
-	processAndSortUsers(leetifyUsers);
-	renderTable(mySteamID, leetifyUsers);
+	auto terminal = ftxui::Terminal::Size();
+	auto line = message.substr(0, message.find('\n'));
+
+	std::lock_guard lock(s_frameMutex);
+
+	s_statusLines.push_back(clampToWidth(line, terminal.dimx));
+	if (s_statusLines.size() > MAX_STATUS_LINES)
+	{
+		s_statusLines.pop_front();
+	}
+
+	presentFrame(terminal.dimx, terminal.dimy);
+}
+
+void Render(CSteamID mySteamID, std::vector<LeetifyUser> &leetifyUsers, TeammateGraph &teammateGraph,
+            const StatsStore &statsHistory)
+{
+	processAndSortUsers(leetifyUsers, teammateGraph);
+
+	// Lines wider than the terminal would wrap and throw off the cursor movement
+	auto terminal = ftxui::Terminal::Size();
+	auto lines = renderTable(mySteamID, leetifyUsers, statsHistory, terminal.dimx);
+
+	auto averages = renderLobbyAverages(leetifyUsers);
+	if (!averages.empty())
+	{
+		lines.push_back(clampToWidth(averages, terminal.dimx));
+	}
+
+	lines.push_back("");
+	lines.push_back(clampToWidth("Reaction is time to damage.", terminal.dimx));
+	lines.push_back(clampToWidth("Ctrl+Click on player name to open on Leetify.", terminal.dimx));
+
+	std::lock_guard lock(s_frameMutex);
+
+	// Status lines were clamped to the width they arrived at
+	if (terminal.dimx != s_frameWidth)
+	{
+		for (auto &status : s_statusLines)
+		{
+			status = clampToWidth(status, terminal.dimx);
+		}
+	}
 
-	printf("\n\nReaction is time to damage.");
-	printf("\nCtrl+Click on player name to open on Leetify.");
-	printf("\n");
+	s_tableLines = std::move(lines);
+	presentFrame(terminal.dimx, terminal.dimy);
 }
@@ -1,4 +1,11 @@
 #include "leetify_provider.h"
+#include "stats_store.h"
+#include "teammate_graph.h"
+#include <string>
 #include <vector>
 
-void Render(CSteamID mySteamID, std::vector<LeetifyUser> leetifyUsers);
+void Render(CSteamID mySteamID, std::vector<LeetifyUser> &leetifyUsers, TeammateGraph &teammateGraph,
+            const StatsStore &statsHistory);
+
+// Shows a message below the table instead of printing over it, callable from any thread
+void PrintStatus(const std::string &message);
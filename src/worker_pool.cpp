@@ -0,0 +1,136 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t threadCount)
+{
+	threadCount = (std::max)(threadCount, size_t(1));
+
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		queues.push_back(std::make_unique<Queue>());
+	}
+
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back(&WorkerPool::WorkerLoop, this, i);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock(wakeMutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void WorkerPool::Submit(std::function<void()> task)
+{
+	auto &queue = *queues[nextQueue++ % queues.size()];
+
+	{
+		std::lock_guard lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard lock(wakeMutex);
+		queued++;
+	}
+
+	wake.notify_one();
+}
+
+WorkerPool &WorkerPool::Shared()
+{
+	// Never destroyed, transfers finishing in the background may still submit work while the process exits
+	static auto *pool = new WorkerPool(std::thread::hardware_concurrency());
+	return *pool;
+}
+
+bool WorkerPool::TryTake(size_t index, std::function<void()> &task)
+{
+	// Newest task from our own deque first, then the oldest one from everybody else's
+	{
+		auto &own = *queues[index];
+		std::lock_guard lock(own.mutex);
+
+		if (!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		auto &victim = *queues[(index + i) % queues.size()];
+		std::lock_guard lock(victim.mutex);
+
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkerPool::WorkerLoop(size_t index)
+{
+	while (true)
+	{
+		{
+			std::unique_lock lock(wakeMutex);
+			wake.wait(lock, [this]() { return stopping || queued > 0; });
+
+			if (queued == 0)
+			{
+				return;
+			}
+
+			// Claims one task, it is guaranteed to be sitting in one of the deques
+			queued--;
+		}
+
+		std::function<void()> task;
+		while (!TryTake(index, task))
+		{
+			std::this_thread::yield();
+		}
+
+		task();
+	}
+}
+
+void TaskGroup::Add()
+{
+	std::lock_guard lock(mutex);
+	outstanding++;
+}
+
+void TaskGroup::Done()
+{
+	std::lock_guard lock(mutex);
+
+	if (--outstanding == 0)
+	{
+		idle.notify_all();
+	}
+}
+
+void TaskGroup::Wait()
+{
+	std::unique_lock lock(mutex);
+	idle.wait(lock, [this]() { return outstanding == 0; });
+}
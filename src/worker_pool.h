@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads, each with its own task deque. Idle workers steal from the others.
+class WorkerPool
+{
+  public:
+	explicit WorkerPool(size_t threadCount);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	void Submit(std::function<void()> task);
+
+	// One worker per core, lives for the whole process
+	static WorkerPool &Shared();
+
+  private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void WorkerLoop(size_t index);
+	bool TryTake(size_t index, std::function<void()> &task);
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> nextQueue{0};
+
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	size_t queued = 0;
+	bool stopping = false;
+};
+
+// Counts outstanding tasks so a caller can wait for just the ones it submitted
+class TaskGroup
+{
+  public:
+	void Add();
+	void Done();
+	void Wait();
+
+  private:
+	std::mutex mutex;
+	std::condition_variable idle;
+	size_t outstanding = 0;
+};
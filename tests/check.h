@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdio>
+
+// Shared by the tests, a failed check is reported and the test carries on with the next one
+
+inline int g_CheckFailures = 0;
+
+inline void Check(bool condition, const char *what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		g_CheckFailures++;
+	}
+}
+
+// Prints how the checks went, returns the test's exit code
+inline int CheckSummary()
+{
+	if (g_CheckFailures > 0)
+	{
+		printf("%d checks failed\n", g_CheckFailures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
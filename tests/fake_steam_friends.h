@@ -0,0 +1,122 @@
+#pragma once
+
+#include "steam_api.h"
+#include <string>
+#include <unordered_map>
+
+// Stands in for the Steam client's friends interface. Names read "[unknown]" until SetName is called, like the real
+// thing between RequestUserInformation and its PersonaStateChange_t.
+class FakeSteamFriends : public ISteamFriends
+{
+  public:
+	// Steam knows the name from now on, whether it was asked for or not
+	void SetName(CSteamID steamID, const std::string &name)
+	{
+		names[steamID.ConvertToUint64()] = name;
+	}
+
+	int RequestCount(CSteamID steamID) const
+	{
+		auto it = requests.find(steamID.ConvertToUint64());
+		return it != requests.end() ? it->second : 0;
+	}
+
+	// Returns true when the name has to be fetched first
+	bool RequestUserInformation(CSteamID steamID, bool) override
+	{
+		requests[steamID.ConvertToUint64()]++;
+		return !names.contains(steamID.ConvertToUint64());
+	}
+
+	const char *GetFriendPersonaName(CSteamID steamID) override
+	{
+		auto it = names.find(steamID.ConvertToUint64());
+		return it != names.end() ? it->second.c_str() : "[unknown]";
+	}
+
+	// Everything else the cache never calls
+	const char *GetPersonaName() override { return {}; }
+	SteamAPICall_t SetPersonaName(const char *) override { return {}; }
+	EPersonaState GetPersonaState() override { return {}; }
+	int GetFriendCount(int) override { return {}; }
+	CSteamID GetFriendByIndex(int, int) override { return {}; }
+	EFriendRelationship GetFriendRelationship(CSteamID) override { return {}; }
+	EPersonaState GetFriendPersonaState(CSteamID) override { return {}; }
+	bool GetFriendGamePlayed(CSteamID, FriendGameInfo_t *) override { return {}; }
+	const char *GetFriendPersonaNameHistory(CSteamID, int) override { return {}; }
+	int GetFriendSteamLevel(CSteamID) override { return {}; }
+	const char *GetPlayerNickname(CSteamID) override { return {}; }
+	int GetFriendsGroupCount() override { return {}; }
+	FriendsGroupID_t GetFriendsGroupIDByIndex(int) override { return {}; }
+	const char *GetFriendsGroupName(FriendsGroupID_t) override { return {}; }
+	int GetFriendsGroupMembersCount(FriendsGroupID_t) override { return {}; }
+	void GetFriendsGroupMembersList(FriendsGroupID_t, CSteamID *, int) override {}
+	bool HasFriend(CSteamID, int) override { return {}; }
+	int GetClanCount() override { return {}; }
+	CSteamID GetClanByIndex(int) override { return {}; }
+	const char *GetClanName(CSteamID) override { return {}; }
+	const char *GetClanTag(CSteamID) override { return {}; }
+	bool GetClanActivityCounts(CSteamID, int *, int *, int *) override { return {}; }
+	SteamAPICall_t DownloadClanActivityCounts(CSteamID *, int) override { return {}; }
+	int GetFriendCountFromSource(CSteamID) override { return {}; }
+	CSteamID GetFriendFromSourceByIndex(CSteamID, int) override { return {}; }
+	bool IsUserInSource(CSteamID, CSteamID) override { return {}; }
+	void SetInGameVoiceSpeaking(CSteamID, bool) override {}
+	void ActivateGameOverlay(const char *) override {}
+	void ActivateGameOverlayToUser(const char *, CSteamID) override {}
+	void ActivateGameOverlayToWebPage(const char *, EActivateGameOverlayToWebPageMode) override {}
+	void ActivateGameOverlayToStore(AppId_t, EOverlayToStoreFlag) override {}
+	void SetPlayedWith(CSteamID) override {}
+	void ActivateGameOverlayInviteDialog(CSteamID) override {}
+	int GetSmallFriendAvatar(CSteamID) override { return {}; }
+	int GetMediumFriendAvatar(CSteamID) override { return {}; }
+	int GetLargeFriendAvatar(CSteamID) override { return {}; }
+	SteamAPICall_t RequestClanOfficerList(CSteamID) override { return {}; }
+	CSteamID GetClanOwner(CSteamID) override { return {}; }
+	int GetClanOfficerCount(CSteamID) override { return {}; }
+	CSteamID GetClanOfficerByIndex(CSteamID, int) override { return {}; }
+	uint32 GetUserRestrictions() override { return {}; }
+	bool SetRichPresence(const char *, const char *) override { return {}; }
+	void ClearRichPresence() override {}
+	const char *GetFriendRichPresence(CSteamID, const char *) override { return {}; }
+	int GetFriendRichPresenceKeyCount(CSteamID) override { return {}; }
+	const char *GetFriendRichPresenceKeyByIndex(CSteamID, int) override { return {}; }
+	void RequestFriendRichPresence(CSteamID) override {}
+	bool InviteUserToGame(CSteamID, const char *) override { return {}; }
+	int GetCoplayFriendCount() override { return {}; }
+	CSteamID GetCoplayFriend(int) override { return {}; }
+	int GetFriendCoplayTime(CSteamID) override { return {}; }
+	AppId_t GetFriendCoplayGame(CSteamID) override { return {}; }
+	SteamAPICall_t JoinClanChatRoom(CSteamID) override { return {}; }
+	bool LeaveClanChatRoom(CSteamID) override { return {}; }
+	int GetClanChatMemberCount(CSteamID) override { return {}; }
+	CSteamID GetChatMemberByIndex(CSteamID, int) override { return {}; }
+	bool SendClanChatMessage(CSteamID, const char *) override { return {}; }
+	int GetClanChatMessage(CSteamID, int, void *, int, EChatEntryType *, CSteamID *) override { return {}; }
+	bool IsClanChatAdmin(CSteamID, CSteamID) override { return {}; }
+	bool IsClanChatWindowOpenInSteam(CSteamID) override { return {}; }
+	bool OpenClanChatWindowInSteam(CSteamID) override { return {}; }
+	bool CloseClanChatWindowInSteam(CSteamID) override { return {}; }
+	bool SetListenForFriendsMessages(bool) override { return {}; }
+	bool ReplyToFriendMessage(CSteamID, const char *) override { return {}; }
+	int GetFriendMessage(CSteamID, int, void *, int, EChatEntryType *) override { return {}; }
+	SteamAPICall_t GetFollowerCount(CSteamID) override { return {}; }
+	SteamAPICall_t IsFollowing(CSteamID) override { return {}; }
+	SteamAPICall_t EnumerateFollowingList(uint32) override { return {}; }
+	bool IsClanPublic(CSteamID) override { return {}; }
+	bool IsClanOfficialGameGroup(CSteamID) override { return {}; }
+	int GetNumChatsWithUnreadPriorityMessages() override { return {}; }
+	void ActivateGameOverlayRemotePlayTogetherInviteDialog(CSteamID) override {}
+	bool RegisterProtocolInOverlayBrowser(const char *) override { return {}; }
+	void ActivateGameOverlayInviteDialogConnectString(const char *) override {}
+	SteamAPICall_t RequestEquippedProfileItems(CSteamID) override { return {}; }
+	bool BHasEquippedProfileItem(CSteamID, ECommunityProfileItemType) override { return {}; }
+	const char *GetProfileItemPropertyString(CSteamID, ECommunityProfileItemType,
+	                                         ECommunityProfileItemProperty) override { return {}; }
+	uint32 GetProfileItemPropertyUint(CSteamID, ECommunityProfileItemType,
+	                                  ECommunityProfileItemProperty) override { return {}; }
+
+  private:
+	std::unordered_map<uint64, std::string> names;
+	std::unordered_map<uint64, int> requests;
+};
@@ -0,0 +1,267 @@
+// Runs LeetifyProxy against a stub upstream and checks that one batched request returns exactly what fetching every
+// profile on its own does
+#include "check.h"
+#include "leetify_proxy.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#define closesocket_ closesocket
+#define SHUT_RDWR SD_BOTH
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#define closesocket_ close
+#endif
+
+#include <curl/curl.h>
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Serves /profiles/<steam64> from a fixed set of bodies, anything else is a 404. One connection at a time.
+class StubUpstream
+{
+  public:
+	std::map<std::string, std::string> bodies;
+
+	bool Start()
+	{
+		server = socket(AF_INET, SOCK_STREAM, 0);
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		socklen_t length = sizeof(address);
+		if (server == INVALID_SOCKET || bind(server, (sockaddr *)&address, sizeof(address)) != 0 ||
+		    listen(server, SOMAXCONN) != 0 || getsockname(server, (sockaddr *)&address, &length) != 0)
+		{
+			return false;
+		}
+
+		port = ntohs(address.sin_port);
+		thread = std::thread([this]() { Serve(); });
+		return true;
+	}
+
+	void Stop()
+	{
+		shutdown(server, SHUT_RDWR);
+		closesocket_(server);
+		thread.join();
+	}
+
+	std::string Url() const
+	{
+		return "http://127.0.0.1:" + std::to_string(port) + "/profiles/";
+	}
+
+	int Requests(const std::string &id)
+	{
+		std::lock_guard lock(mutex);
+		return requests[id];
+	}
+
+  private:
+	void Serve()
+	{
+		while (true)
+		{
+			auto client = accept(server, nullptr, nullptr);
+			if (client == INVALID_SOCKET)
+			{
+				return;
+			}
+
+			std::string request;
+			char buffer[4096];
+
+			while (request.find("\r\n\r\n") == std::string::npos)
+			{
+				auto n = recv(client, buffer, sizeof(buffer), 0);
+				if (n <= 0)
+				{
+					break;
+				}
+				request.append(buffer, n);
+			}
+
+			// GET /profiles/<id> HTTP/1.1
+			auto pathStart = request.find(' ') + 1;
+			auto path = request.substr(pathStart, request.find(' ', pathStart) - pathStart);
+			auto id = path.substr(path.rfind('/') + 1);
+
+			{
+				std::lock_guard lock(mutex);
+				requests[id]++;
+			}
+
+			auto it = bodies.find(id);
+			auto status = it != bodies.end() ? "200 OK" : "404 Not Found";
+			auto body = it != bodies.end() ? it->second : R"({"error":"not found"})";
+
+			auto response = std::string("HTTP/1.1 ") + status + "\r\nContent-Type: application/json\r\n" +
+			                "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+			send(client, response.data(), (int)response.size(), 0);
+			closesocket_(client);
+		}
+	}
+
+	Socket server = INVALID_SOCKET;
+	int port = 0;
+	std::thread thread;
+	std::mutex mutex;
+	std::map<std::string, int> requests;
+};
+
+struct Response
+{
+	long status = 0;
+	std::string headers;
+	std::string body;
+};
+
+static size_t Append(void *contents, size_t size, size_t nmemb, std::string *s)
+{
+	s->append((char *)contents, size * nmemb);
+	return size * nmemb;
+}
+
+static Response Get(const std::string &url, const char *method = "GET")
+{
+	Response response;
+
+	auto curl = curl_easy_init();
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Append);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, Append);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response.headers);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+
+	if (curl_easy_perform(curl) == CURLE_OK)
+	{
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+	}
+
+	curl_easy_cleanup(curl);
+	return response;
+}
+
+// What a client fetching the profile on its own would end up with, in the proxy's terms
+static nlohmann::json Expected(const Response &single, long *status)
+{
+	*status = single.status;
+
+	if (single.status == 200)
+	{
+		try
+		{
+			return nlohmann::json::parse(single.body);
+		}
+		catch (const std::exception &)
+		{
+			*status = 502;
+		}
+	}
+
+	return nullptr;
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		printf("Failed to initialize Winsock\n");
+		return 1;
+	}
+#endif
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	StubUpstream upstream;
+	upstream.bodies["76561198000000001"] = R"({"name":"one","winrate":0.51,"total_matches":120,"ranks":{"premier":15000}})";
+	upstream.bodies["76561198000000002"] = R"({"name":"twö","winrate":0.47,"recent_teammates":[{"steam64_id":"1"}]})";
+	upstream.bodies["76561198000000003"] = R"({"name":"three","bans":[{"platform":"faceit"}]})";
+	upstream.bodies["76561198000000005"] = R"({"name":"truncated)";
+
+	if (!upstream.Start())
+	{
+		printf("Failed to start the stub upstream\n");
+		return 1;
+	}
+
+	LeetifyProxy proxy(upstream.Url());
+	if (!proxy.Listen(0))
+	{
+		printf("Failed to start the proxy\n");
+		return 1;
+	}
+
+	std::thread serving([&proxy]() { proxy.Serve(); });
+	auto endpoint = "http://127.0.0.1:" + std::to_string(proxy.Port()) + "/v2/profiles";
+
+	// Found, found, found, missing upstream and unparseable
+	std::vector<std::string> ids = {"76561198000000001", "76561198000000002", "76561198000000003",
+	                                "76561198000000004", "76561198000000005"};
+
+	auto batched = Get(endpoint + "?ids=" + ids[0] + "," + ids[1] + "," + ids[2] + "," + ids[3] + "," + ids[4]);
+	Check(batched.status == 200, "batched request succeeds");
+	Check(batched.headers.find("Content-Encoding: gzip") != std::string::npos, "batched response is gzipped");
+
+	auto combined = nlohmann::json::parse(batched.body, nullptr, false);
+	Check(combined.is_object() && combined.contains("profiles") && combined.contains("errors"),
+	      "batched response has profiles and errors");
+
+	for (const auto &id : ids)
+	{
+		long status;
+		auto expected = Expected(Get(upstream.Url() + id), &status);
+
+		if (status == 200)
+		{
+			Check(combined["profiles"].contains(id) && combined["profiles"][id] == expected,
+			      ("profile " + id + " matches the single fetch").c_str());
+			Check(!combined["errors"].contains(id), ("profile " + id + " is not an error").c_str());
+		}
+		else
+		{
+			Check(combined["errors"].contains(id) && combined["errors"][id] == status,
+			      ("error " + id + " matches the single fetch").c_str());
+			Check(!combined["profiles"].contains(id), ("error " + id + " has no profile").c_str());
+		}
+	}
+
+	// Served from the cache, percent-encoded commas and duplicates included
+	auto cached = Get(endpoint + "?ids=" + ids[0] + "%2C" + ids[0] + "%2c" + ids[1] + "," + ids[3]);
+	auto cachedJson = nlohmann::json::parse(cached.body, nullptr, false);
+	Check(cached.status == 200 && cachedJson["profiles"].size() == 2 && cachedJson["errors"].size() == 1,
+	      "repeated request is deduplicated");
+	Check(cachedJson["profiles"][ids[0]] == combined["profiles"][ids[0]], "cached profile matches");
+	Check(upstream.Requests(ids[0]) == 2 && upstream.Requests(ids[3]) == 2,
+	      "cached profiles and 404s are not fetched again");
+
+	Check(Get(endpoint).status == 400, "missing ids are rejected");
+	Check(Get(endpoint + "?ids=abc,-1").status == 400, "non-numeric ids are rejected");
+	Check(Get(endpoint + "?ids=" + ids[0], "POST").status == 405, "only GET is allowed");
+	Check(Get("http://127.0.0.1:" + std::to_string(proxy.Port()) + "/v2/other").status == 404,
+	      "unknown routes are 404");
+
+	proxy.Stop();
+	serving.join();
+	upstream.Stop();
+
+	curl_global_cleanup();
+
+	return CheckSummary();
+}
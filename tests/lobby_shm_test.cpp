@@ -0,0 +1,176 @@
+// Publishes lobbies as fast as possible while readers copy them, every snapshot read must come from a single publish
+#include "check.h"
+#include "lobby_shm.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+constexpr auto TEST_SHM_NAME = "Local\\CS2PlayerFetcherLobbyTest";
+#else
+constexpr auto TEST_SHM_NAME = "/cs2_player_fetcher_lobby_test";
+#endif
+
+constexpr uint64_t PUBLISHES = 200000;
+constexpr int READERS = 3;
+
+// Every field of every player is derived from the publish it belongs to, and so is the player count
+static std::vector<LobbyShmPlayer> MakeLobby(uint64_t publish)
+{
+	std::vector<LobbyShmPlayer> players(1 + publish % LOBBY_SHM_MAX_PLAYERS);
+
+	for (size_t i = 0; i < players.size(); i++)
+	{
+		auto &player = players[i];
+		player = {};
+		player.steamID = publish;
+		player.lobbyID = static_cast<int32_t>(i);
+		player.premier = static_cast<int32_t>(publish);
+		player.totalMatches = static_cast<int32_t>(publish ^ i);
+		snprintf(player.name, sizeof(player.name), "player %llu", static_cast<unsigned long long>(publish));
+	}
+
+	return players;
+}
+
+static bool Consistent(const LobbyShmSnapshot &snapshot)
+{
+	if (snapshot.playerCount == 0)
+	{
+		return false;
+	}
+
+	auto publish = snapshot.players[0].steamID;
+	if (snapshot.playerCount != 1 + publish % LOBBY_SHM_MAX_PLAYERS)
+	{
+		return false;
+	}
+
+	auto expected = MakeLobby(publish);
+	return std::memcmp(snapshot.players, expected.data(), snapshot.playerCount * sizeof(LobbyShmPlayer)) == 0;
+}
+
+static void TestConcurrentReads()
+{
+	LobbyShmPublisher publisher;
+	Check(publisher.Open(TEST_SHM_NAME), "publisher opens the segment");
+
+	LobbyShmReader reader;
+	Check(reader.Open(TEST_SHM_NAME), "reader opens the segment");
+
+	LobbyShmSnapshot snapshot;
+	Check(!reader.Read(snapshot), "nothing to read before the first publish");
+
+	publisher.Publish(MakeLobby(1));
+
+	std::atomic<bool> done = false;
+	std::atomic<long> reads = 0;
+	std::atomic<long> torn = 0;
+	std::vector<std::thread> readers;
+
+	for (int i = 0; i < READERS; i++)
+	{
+		readers.emplace_back([&]() {
+			LobbyShmSnapshot copy;
+			uint64_t lastPublish = 0;
+
+			while (!done)
+			{
+				if (!reader.Read(copy))
+				{
+					continue;
+				}
+
+				reads++;
+
+				// Torn, or older than a snapshot this reader has already seen
+				if (!Consistent(copy) || copy.players[0].steamID < lastPublish)
+				{
+					torn++;
+				}
+
+				lastPublish = copy.players[0].steamID;
+			}
+		});
+	}
+
+	for (uint64_t publish = 2; publish <= PUBLISHES; publish++)
+	{
+		publisher.Publish(MakeLobby(publish));
+	}
+
+	done = true;
+	for (auto &thread : readers)
+	{
+		thread.join();
+	}
+
+	printf("%ld reads during %llu publishes, %ld torn\n", reads.load(), static_cast<unsigned long long>(PUBLISHES),
+	       torn.load());
+
+	Check(torn == 0, "no torn or stale reads");
+	Check(reader.Generation() == PUBLISHES, "generation counts publishes");
+	Check(reader.Read(snapshot) && snapshot.players[0].steamID == PUBLISHES, "the last publish is read");
+}
+
+static void TestStuckWriter()
+{
+	LobbyShmPublisher publisher;
+	Check(publisher.Open(TEST_SHM_NAME), "publisher opens the segment");
+	publisher.Publish(MakeLobby(1));
+
+	LobbyShmReader reader;
+	Check(reader.Open(TEST_SHM_NAME), "reader opens the segment");
+
+	// A writer that died between marking both slots busy and finishing them
+	LobbyShmMapping writer;
+	Check(writer.Map(true, TEST_SHM_NAME), "second writable mapping");
+	writer.Segment()->slots[0].sequence.fetch_add(1);
+	writer.Segment()->slots[1].sequence.fetch_add(1);
+
+	LobbyShmSnapshot snapshot;
+	Check(!reader.Read(snapshot), "read gives up on a slot that stays odd");
+
+	writer.Segment()->slots[0].sequence.fetch_add(1);
+	writer.Segment()->slots[1].sequence.fetch_add(1);
+	Check(reader.Read(snapshot) && Consistent(snapshot), "read recovers once the slot is even again");
+}
+
+static void TestNameTruncation()
+{
+	LobbyShmPlayer player{};
+
+	CopyLobbyShmName(player, "short");
+	Check(std::strcmp(player.name, "short") == 0, "short names are copied whole");
+
+	// 62 ASCII bytes and a 3-byte character that would straddle the 63 byte limit
+	auto name = std::string(62, 'a') + "\xE2\x82\xAC";
+	CopyLobbyShmName(player, name);
+	Check(std::strlen(player.name) == 62, "a character that doesn't fit is dropped whole");
+
+	// 61 ASCII bytes and a 2-byte character end exactly at the limit
+	name = std::string(61, 'a') + "\xC3\xA9" + "tail";
+	CopyLobbyShmName(player, name);
+	Check(std::strlen(player.name) == 63 && std::strcmp(player.name + 61, "\xC3\xA9") == 0,
+	      "a character that fits exactly is kept");
+
+	name.clear();
+	for (int i = 0; i < 30; i++)
+	{
+		name += "\xF0\x9F\x98\x80"; // 4 bytes each
+	}
+	CopyLobbyShmName(player, name);
+	Check(std::strlen(player.name) == 60, "multi-byte names are cut between characters");
+}
+
+int main()
+{
+	TestConcurrentReads();
+	TestStuckWriter();
+	TestNameTruncation();
+
+	return CheckSummary();
+}
@@ -0,0 +1,90 @@
+// Drives PersonaCache against a fake ISteamFriends: names known up front, names that arrive later and the cache file
+#include "check.h"
+#include "fake_steam_friends.h"
+#include "persona_cache.h"
+#include <cstdio>
+#include <filesystem>
+
+static const CSteamID KNOWN(76561198000000001ull);
+static const CSteamID LATE(76561198000000002ull);
+static const CSteamID NEVER(76561198000000003ull);
+
+static void TestKnownName()
+{
+	FakeSteamFriends friends;
+	friends.SetName(KNOWN, "known");
+
+	PersonaCache cache(&friends);
+	cache.Request({KNOWN});
+
+	Check(cache.Lookup(KNOWN) == "known", "a name Steam has is stored by Request");
+	Check(friends.RequestCount(KNOWN) == 1, "Request asks Steam once");
+
+	// Resolved names are not asked for again
+	friends.SetName(KNOWN, "renamed");
+	cache.Refresh();
+	Check(cache.Lookup(KNOWN) == "known", "Refresh only looks at unresolved names");
+}
+
+static void TestLateName()
+{
+	FakeSteamFriends friends;
+	PersonaCache cache(&friends);
+
+	cache.Request({LATE, NEVER});
+	Check(cache.Lookup(LATE).empty(), "an unknown name is empty until it arrives");
+
+	cache.Refresh();
+	Check(cache.Lookup(LATE).empty(), "Refresh before the name arrives stores nothing");
+
+	friends.SetName(LATE, "late");
+	cache.Refresh();
+	Check(cache.Lookup(LATE) == "late", "Refresh picks up a name that arrived");
+	Check(cache.Lookup(NEVER).empty(), "names that never arrive stay empty");
+
+	// Asking again for a player already waiting doesn't queue them twice
+	cache.Request({NEVER});
+	friends.SetName(NEVER, "finally");
+	cache.Refresh();
+	Check(cache.Lookup(NEVER) == "finally", "a name requested twice is picked up once it arrives");
+}
+
+static void TestWithoutSteam()
+{
+	PersonaCache cache;
+	cache.Request({KNOWN});
+	cache.Refresh();
+	Check(cache.Lookup(KNOWN).empty(), "without Steam nothing is resolved");
+
+	cache.Set(KNOWN, "[unknown]");
+	cache.Set(LATE, "");
+	Check(cache.Names().empty(), "placeholder and empty names are never stored");
+}
+
+static void TestRoundTrip()
+{
+	auto path = (std::filesystem::temp_directory_path() / "persona_cache_test.txt").string();
+
+	PersonaCache saved;
+	saved.Set(KNOWN, "plain");
+	saved.Set(LATE, "with spaces and ünïcödé");
+	saved.Set(NEVER, " leading space");
+	Check(saved.Save(path), "Save writes the file");
+
+	PersonaCache loaded;
+	Check(loaded.Load(path), "Load reads the file");
+	Check(loaded.Names() == saved.Names(), "names survive a save and load");
+
+	std::filesystem::remove(path);
+	Check(!PersonaCache().Load(path), "Load fails on a missing file");
+}
+
+int main()
+{
+	TestKnownName();
+	TestLateName();
+	TestWithoutSteam();
+	TestRoundTrip();
+
+	return CheckSummary();
+}
@@ -2,10 +2,24 @@ add_rules("mode.debug", "mode.release")
 add_requires("nlohmann_json")
 add_requires("libcurl")
 add_requires("ftxui")
+add_requires("zlib")
+
+target("LobbyShm")
+	set_kind("static")
+	add_files("src/lobby_shm.cpp")
+	add_headerfiles("src/lobby_shm.h")
+	add_includedirs("src", {public = true})
+
+	if is_plat("linux") then
+		add_syslinks("rt", "pthread", {public = true})
+	end
+
+	set_languages("cxx20")
 
 target("PlayerFetch")
 	set_kind("binary")
-	add_files("src/**.cpp")
+	add_deps("LobbyShm")
+	add_files("src/**.cpp|lobby_shm.cpp")
 	add_headerfiles("src/**.h")
 	add_packages("nlohmann_json", "ftxui", "libcurl")
 
@@ -20,3 +34,58 @@ target("PlayerFetch")
 
 	set_languages("cxx20")
 	set_exceptions("cxx")
+
+target("LeetifyProxy")
+	set_kind("binary")
+	add_files("proxy/**.cpp")
+	add_packages("nlohmann_json", "libcurl", "zlib")
+
+	if is_plat("windows") then
+		add_links("ws2_32")
+	end
+
+	set_languages("cxx20")
+	set_exceptions("cxx")
+
+target("LobbyShmTest")
+	set_kind("binary")
+	set_default(false)
+	add_deps("LobbyShm")
+	add_files("tests/lobby_shm_test.cpp")
+	add_tests("default")
+
+	set_languages("cxx20")
+
+target("PersonaCacheTest")
+	set_kind("binary")
+	set_default(false)
+	add_files("tests/persona_cache_test.cpp", "src/persona_cache.cpp")
+	add_includedirs("src", "vendor/steam/public")
+	add_tests("default")
+
+	set_languages("cxx20")
+
+target("DecodeBench")
+	set_kind("binary")
+	set_default(false)
+	add_files("bench/decode_bench.cpp", "src/leetify_provider.cpp", "src/session_capture.cpp", "src/worker_pool.cpp")
+	add_includedirs("src", "vendor/steam/public")
+	add_packages("nlohmann_json", "libcurl")
+
+	set_languages("cxx20")
+	set_exceptions("cxx")
+
+target("LeetifyProxyTest")
+	set_kind("binary")
+	set_default(false)
+	add_files("tests/leetify_proxy_test.cpp", "proxy/leetify_proxy.cpp")
+	add_includedirs("proxy")
+	add_packages("nlohmann_json", "libcurl", "zlib")
+	add_tests("default")
+
+	if is_plat("windows") then
+		add_links("ws2_32")
+	end
+
+	set_languages("cxx20")
+	set_exceptions("cxx")